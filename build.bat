@@ -6,7 +6,8 @@ REM Set the build file and output executable names, compile flags, and libraries
 set output_exe_name=VecFinder.exe
 set build_file_name=Build.cpp
 
-set common_flags=/W3 /Gm- /EHsc /nologo
+REM The solver uses AVX2 if it's available. Remove /arch:AVX2 to build for older CPUs, or use /arch:AVX512 for newer ones.
+set common_flags=/W3 /Gm- /EHsc /nologo /std:c++17 /arch:AVX2
 set debug_flags=/Od /Z7 /MTd /D DEBUG
 set release_flags=/O2 /GL /MT /analyze- /D NDEBUG
 
@@ -0,0 +1,157 @@
+"""
+Stand-in client for serve mode, to check it still answers pipelined requests properly after changing it.
+
+It starts the server on stdin, sends every request in one go, and checks that each one got the right kind of response,
+in order. Then (where Python has Unix domain sockets) it starts the server on a socket, connects a few clients at once,
+has each of them pipeline the same requests, and checks they all get exactly the same responses stdin did.
+
+Run it from the repo root, after building:
+python scripts/check_serve.py bin/release/VecFinder.exe
+python scripts/check_serve.py bin/release/VecFinder.exe 14 13 triangles.csv starmap.csv mapping2d.csv
+
+Exits with 1 and says what went wrong if any check fails.
+"""
+
+import os
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+CLIENT_COUNT = 4
+TIMEOUT_SECONDS = 60
+
+# Each request, and what its response has to start with.
+REQUESTS = [
+	("solve 1,2,3", "ok "),
+	("solve -0.3,0.1,0.9", "ok "),
+	("solve 0,0,0", "err "),
+	("solve nan,1,1", "err "),
+	("solve inf,0,0", "err "),
+	("solve 1,2", "err "),
+	("decode 8,37,11,30,35,16,24,38", "ok "),
+	("decode 1,2,3", "err "),
+	("burb 100,50,50,-1,1,0,1,1,0,-1,-1,0", "ok "),
+	("metrics", "err "),
+	("bogus", "err "),
+]
+
+# Enough copies that the stdin server splits them between threads, and socket reads end mid-line.
+REPEATS = 200
+
+
+def fail(message):
+	print("FAILED: " + message)
+	sys.exit(1)
+
+
+def make_requests():
+	lines = []
+	for i in range(REPEATS):
+		for request, _ in REQUESTS:
+			lines.append(request)
+		# A different solve every time, so responses that come back out of order get noticed when the socket clients
+		# are compared with stdin. Not every direction lands on a face, so these can be either ok or err.
+		lines.append("solve %d,%d,%d" % (i % 7 - 3, i % 5 - 2, i % 3 + 1))
+	return lines
+
+
+def check_responses(name, lines, responses):
+	if len(responses) != len(lines):
+		fail("%s got %d responses to %d requests" % (name, len(responses), len(lines)))
+	for i, (request, response) in enumerate(zip(lines, responses)):
+		expected = ("ok ", "err ")
+		for known, prefix in REQUESTS:
+			if request == known:
+				expected = (prefix,)
+		if not response.startswith(expected):
+			fail("%s request %d \"%s\" got \"%s\", expected it to start with \"%s\"" % (name, i + 1, request, response, expected[0].strip()))
+
+
+def check_stdin(server_args, lines):
+	print("Pipelining %d requests over stdin" % len(lines))
+	data = "".join(line + "\n" for line in lines)
+	result = subprocess.run(server_args, input=data, capture_output=True, text=True, timeout=TIMEOUT_SECONDS)
+	if result.returncode != 0:
+		fail("stdin server exited with %d: %s" % (result.returncode, result.stdout.strip()))
+	responses = result.stdout.splitlines()
+	check_responses("stdin", lines, responses)
+	return responses
+
+
+def run_socket_client(socket_path, lines, results, index):
+	client = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+	client.settimeout(TIMEOUT_SECONDS)
+	client.connect(socket_path)
+	client.sendall("".join(line + "\n" for line in lines).encode())
+	client.shutdown(socket.SHUT_WR)
+	data = b""
+	while True:
+		chunk = client.recv(65536)
+		if not chunk:
+			break
+		data += chunk
+	client.close()
+	results[index] = data.decode().splitlines()
+
+
+def check_socket(server_args, lines, expected):
+	if not hasattr(socket, "AF_UNIX"):
+		print("Skipping the socket check, this Python doesn't have Unix domain sockets")
+		return
+
+	socket_path = os.path.join(tempfile.mkdtemp(), "serve.sock")
+	args = server_args[:]
+	args[4] = socket_path
+	server = subprocess.Popen(args, stdout=subprocess.PIPE, text=True)
+	try:
+		# Wait until it says it's listening, since loading the ball takes a moment.
+		deadline = time.time() + TIMEOUT_SECONDS
+		while True:
+			line = server.stdout.readline()
+			if not line or time.time() > deadline:
+				fail("socket server never started listening")
+			if line.startswith("Serving requests"):
+				break
+
+		print("Pipelining %d requests from each of %d socket clients at once" % (len(lines), CLIENT_COUNT))
+		results = [None] * CLIENT_COUNT
+		threads = [threading.Thread(target=run_socket_client, args=(socket_path, lines, results, i)) for i in range(CLIENT_COUNT)]
+		for thread in threads:
+			thread.start()
+		for thread in threads:
+			thread.join()
+
+		for i, responses in enumerate(results):
+			if responses is None:
+				fail("socket client %d didn't finish" % (i + 1))
+			check_responses("socket client %d" % (i + 1), lines, responses)
+			if responses != expected:
+				fail("socket client %d got different responses than stdin did" % (i + 1))
+	finally:
+		server.kill()
+		server.wait()
+		if os.path.exists(socket_path):
+			os.remove(socket_path)
+
+
+def main():
+	if len(sys.argv) < 2:
+		print("Usage: check_serve.py exe_path [symbol1 symbol2 triangles_path starmap_path mapping_2d_path]")
+		sys.exit(1)
+	exe_path = sys.argv[1]
+	symbol1 = sys.argv[2] if len(sys.argv) > 2 else "14"
+	symbol2 = sys.argv[3] if len(sys.argv) > 3 else "13"
+	paths = sys.argv[4:7] if len(sys.argv) > 6 else ["triangles.csv", "starmap.csv", "mapping2d.csv"]
+	server_args = [exe_path, "serve", symbol1, symbol2, "-"] + paths
+
+	lines = make_requests()
+	expected = check_stdin(server_args, lines)
+	check_socket(server_args, lines, expected)
+	print("Everything checks out")
+
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,140 @@
+#include "Core.h"
+
+/*
+Finding the orientation of the ball from two vectors throws away everything else in the starmap. With more vectors, we can
+find the rotation that lines up all of them as well as possible at once, which is a least squares problem (Wahba's problem).
+
+This uses Davenport's q-method, in the form from Horn's paper on absolute orientation: all the pairs of vectors get summed
+into a 3x3 matrix, and the best rotation is the eigenvector of a 4x4 matrix built from it with the largest eigenvalue.
+The sums don't depend on the order the pairs come in, so we can add them one at a time as we read them, and solve whenever.
+*/
+
+// If the two largest eigenvalues are closer than this (per unit of weight), the rotation isn't well defined.
+#define ATTITUDE_EIGENVALUE_GAP 0.000000000001
+
+// Everything we need to know about the pairs of vectors added so far.
+struct AttitudeProfile
+{
+	double sums[3][3]; // Sum of weight * reference[i] * observed[j].
+	double weight_sum;
+	s32 count;
+};
+
+// Adds a pair of directions to the profile, where observed is where we saw the reference direction end up after rotating.
+// Neither vector needs to be normalized.
+void AddAttitudeObservation(AttitudeProfile* profile, Vec3 reference, Vec3 observed, double weight)
+{
+	Vec3 r = Normalize(reference);
+	Vec3 b = Normalize(observed);
+	for (s32 i = 0; i < 3; ++i)
+	{
+		for (s32 j = 0; j < 3; ++j) profile->sums[i][j] += weight * r[i] * b[j];
+	}
+	profile->weight_sum += weight;
+	++profile->count;
+}
+
+/*
+Eigenvalues and eigenvectors of a symmetric 4x4 matrix, using Jacobi rotations. It's not the fastest way, but it's tiny,
+always converges, and 4x4 only takes a handful of sweeps. The matrix is destroyed. Eigenvector i is column i of out_vectors.
+*/
+static void SolveSymmetricEigen4(double m[4][4], double out_values[4], double out_vectors[4][4])
+{
+	for (s32 i = 0; i < 4; ++i)
+	{
+		for (s32 j = 0; j < 4; ++j) out_vectors[i][j] = (i == j) ? 1.0 : 0.0;
+	}
+
+	for (s32 sweep = 0; sweep < 50; ++sweep)
+	{
+		double off_diagonal = 0.0;
+		for (s32 p = 0; p < 4; ++p)
+		{
+			for (s32 q = p + 1; q < 4; ++q) off_diagonal += m[p][q] * m[p][q];
+		}
+		if (off_diagonal == 0.0) break;
+
+		for (s32 p = 0; p < 4; ++p)
+		{
+			for (s32 q = p + 1; q < 4; ++q)
+			{
+				if (m[p][q] == 0.0) continue;
+
+				// Pick the rotation angle that zeroes out m[p][q].
+				double theta = (m[q][q] - m[p][p]) / (2.0 * m[p][q]);
+				double t = 1.0 / (Abs(theta) + Sqrt(theta * theta + 1.0));
+				if (theta < 0.0) t = -t;
+				double c = 1.0 / Sqrt(t * t + 1.0);
+				double s = t * c;
+
+				for (s32 k = 0; k < 4; ++k)
+				{
+					double mkp = m[k][p];
+					double mkq = m[k][q];
+					m[k][p] = c * mkp - s * mkq;
+					m[k][q] = s * mkp + c * mkq;
+				}
+				for (s32 k = 0; k < 4; ++k)
+				{
+					double mpk = m[p][k];
+					double mqk = m[q][k];
+					m[p][k] = c * mpk - s * mqk;
+					m[q][k] = s * mpk + c * mqk;
+				}
+				for (s32 k = 0; k < 4; ++k)
+				{
+					double vkp = out_vectors[k][p];
+					double vkq = out_vectors[k][q];
+					out_vectors[k][p] = c * vkp - s * vkq;
+					out_vectors[k][q] = s * vkp + c * vkq;
+				}
+			}
+		}
+	}
+
+	for (s32 i = 0; i < 4; ++i) out_values[i] = m[i][i];
+}
+
+/*
+Finds the rotation that takes the reference directions closest to the observed ones, using every pair added so far.
+The loss is Wahba's loss, half the weighted sum of squared distances between each rotated reference direction and its
+observed direction. For small angles that's about half the weighted sum of squared angles, in radians.
+
+Returns false if the rotation can't be worked out, which happens when there aren't at least two different directions.
+*/
+bool SolveAttitude(const AttitudeProfile& profile, Quat* out_rotation, double* out_loss)
+{
+	const double (*s)[3] = profile.sums;
+	double n[4][4] =
+	{
+		{s[0][0] + s[1][1] + s[2][2], s[1][2] - s[2][1], s[2][0] - s[0][2], s[0][1] - s[1][0]},
+		{s[1][2] - s[2][1], s[0][0] - s[1][1] - s[2][2], s[0][1] + s[1][0], s[2][0] + s[0][2]},
+		{s[2][0] - s[0][2], s[0][1] + s[1][0], -s[0][0] + s[1][1] - s[2][2], s[1][2] + s[2][1]},
+		{s[0][1] - s[1][0], s[2][0] + s[0][2], s[1][2] + s[2][1], -s[0][0] - s[1][1] + s[2][2]},
+	};
+
+	double values[4];
+	double vectors[4][4];
+	SolveSymmetricEigen4(n, values, vectors);
+
+	s32 best = 0;
+	for (s32 i = 1; i < 4; ++i)
+	{
+		if (values[i] > values[best]) best = i;
+	}
+
+	// With only one direction (or all of them the same), the rotation around it could be anything, and the two
+	// largest eigenvalues are the same.
+	double second = values[best == 0 ? 1 : 0];
+	for (s32 i = 0; i < 4; ++i)
+	{
+		if (i != best) second = Max(second, values[i]);
+	}
+	if (profile.count < 2 || values[best] - second <= ATTITUDE_EIGENVALUE_GAP * profile.weight_sum) return false;
+
+	// The eigenvector is (w, x, y, z).
+	Quat q = Quat(vectors[1][best], vectors[2][best], vectors[3][best], vectors[0][best]);
+	*out_rotation = Normalize(q);
+	if (out_loss) *out_loss = Max(profile.weight_sum - values[best], 0.0);
+	return true;
+}
@@ -1,5 +1,7 @@
 #include "Core.h"
 
+#include <utility>
+
 // Golden ratio and 1 / golden ratio.
 #define PHI ((1.0 + Sqrt(5.0)) / 2.0)
 #define IPHI (1.0 / PHI)
@@ -30,8 +32,22 @@ static Vec3 dodecahedron[] = {
 // and it does not work if this value is bigger.
 #define EPSILON 0.000000000000001
 
+// How many symbols follow the first one, and how many pieces each edge of a triangle is split into per symbol.
+// These can be overridden from the compiler command line to experiment with other configurations.
+#ifndef SUBDIVISION_COUNT
 #define SUBDIVISION_COUNT 7
+#endif
+#ifndef SUBDIVISION_AMOUNT
 #define SUBDIVISION_AMOUNT 8
+#endif
+
+// Each subdivision splits a triangle into this many smaller ones, with this many vertices between them.
+#define SUBDIVIDED_TRIANGLE_COUNT (SUBDIVISION_AMOUNT * SUBDIVISION_AMOUNT)
+#define SUBDIVIDED_VERTEX_COUNT ((SUBDIVISION_AMOUNT + 1) * (SUBDIVISION_AMOUNT + 2) / 2)
+
+// A full stargate address is the first symbol, followed by one symbol per subdivision level.
+#define ADDRESS_LENGTH (SUBDIVISION_COUNT + 1)
+
 /*
 I don't really remember everything about how this works. The method is taken mostly from here,
 and is based on a method described in the book "Real Time Rendering":
@@ -47,7 +63,11 @@ bool RayTriangleIntersect(Vec3 d, Vec3 v0, Vec3 v1, Vec3 v2, Vec3* out, double*
 	Vec3 e2 = v2 - v0;
 	Vec3 h = Cross(d, e2);
 	double a = Dot(e1, h);
-	if (a > -EPSILON && a < EPSILON) return false;
+	if (a > -EPSILON && a < EPSILON)
+	{
+		CountMetric(METRIC_DEGENERACIES);
+		return false;
+	}
 	double f = 1.0 / a;
 	double u = f * Dot(-v0, h);
 	if (u < 0.0 || u > 1.0) return false;
@@ -66,11 +86,81 @@ bool RayTriangleIntersect(Vec3 d, Vec3 v0, Vec3 v1, Vec3 v2, Vec3* out, double*
 	else return false;
 }
 
+/*
+Geometry for one triangular face of the oriented ball. We build one of these per face whenever the ball is oriented,
+so that solving a vector never has to rotate anything.
+
+The rows of inv_basis are the inverse of the matrix with v0, v1 and v2 as its columns. Dotting them with a direction gives
+the weight of each vertex, and dividing by the sum of the weights projects the direction onto the face. This gives the
+same barycentric coordinates as raycasting from the origin, but it's just three dot products.
+*/
+struct alignas(64) Face
+{
+	Vec3 v0, v1, v2; // Icosahedron vertex, then the two dodecahedron vertices, same as the triangle table.
+	Vec3 e1, e2; // Edges from v0 to v1 and v2.
+	Vec3 normal; // Unit normal, pointing out of the ball.
+	Vec3 inv_basis[3];
+};
+
+// Fills in a face from its three vertices. The vertices should already be rotated into place.
+static Face BuildFace(Vec3 v0, Vec3 v1, Vec3 v2)
+{
+	Face face = {};
+	face.v0 = v0;
+	face.v1 = v1;
+	face.v2 = v2;
+	face.e1 = v1 - v0;
+	face.e2 = v2 - v0;
+	face.normal = Normalize(Cross(face.e1, face.e2));
+	if (Dot(face.normal, v0) < 0.0) face.normal = -face.normal;
+
+	// Inverse of the matrix with columns v0, v1, v2 is the transposed cofactor matrix over the determinant.
+	// If the face lines up with the origin (which only happens with a broken triangle table), leave the basis zeroed
+	// so that nothing can hit it, the same as how RayTriangleIntersect() treats a ray parallel to the face.
+	double det = Dot(v0, Cross(v1, v2));
+	if (det > -EPSILON && det < EPSILON)
+	{
+		CountMetric(METRIC_DEGENERACIES);
+		return face;
+	}
+	face.inv_basis[0] = Cross(v1, v2) * (1.0 / det);
+	face.inv_basis[1] = Cross(v2, v0) * (1.0 / det);
+	face.inv_basis[2] = Cross(v0, v1) * (1.0 / det);
+	return face;
+}
+
+/*
+Same as the other RayTriangleIntersect(), but using a precomputed face. The direction does not need to be normalized.
+The barycentric coordinates are in the same order, so out_u is the weight of v1, and out_v is the weight of v2.
+*/
+bool RayTriangleIntersect(Vec3 d, const Face& face, Vec3* out, double* out_u, double* out_v)
+{
+	double w0 = Dot(face.inv_basis[0], d);
+	double w1 = Dot(face.inv_basis[1], d);
+	double w2 = Dot(face.inv_basis[2], d);
+	if (w0 < 0.0 || w1 < 0.0 || w2 < 0.0) return false;
+
+	// The sum of the weights is the inverse of the distance along the ray, so this also rejects hits behind the origin.
+	// None of the weights are negative by now, so a sum this small means the ray is right on the face's plane.
+	// A sum of exactly zero is a broken face instead, which BuildFace() already counted.
+	double sum = w0 + w1 + w2;
+	if (sum < EPSILON)
+	{
+		if (sum > 0.0) CountMetric(METRIC_DEGENERACIES);
+		return false;
+	}
+	double inv_sum = 1.0 / sum;
+	if (out) *out = d * inv_sum;
+	if (out_u) *out_u = w1 * inv_sum;
+	if (out_v) *out_v = w2 * inv_sum;
+	return true;
+}
+
 /*
 Gets the direction vector associated with the symbol. Note that this is *not* the normal vector of the face,
 it is actually the centroid. We compute it by just adding the vertex positions and normalizing.
 */
-static Vec3 GetSymbolDirection(s32 symbol_id, IVec3 triangle_table[60])
+static Vec3 GetSymbolDirection(s32 symbol_id, const IVec3 triangle_table[60])
 {
 	s32 ico_idx = triangle_table[symbol_id - 1].x;
 	s32 dod_idx1 = triangle_table[symbol_id - 1].y;
@@ -91,30 +181,11 @@ I don't have a good way for you to generate this lookup table... I put together
 MS Paint using screenshots of all the pyramids, and built a visualizer tool in UE5 (too big to include in this repo)
 to help construct the lookup table by hand.
 */
-static bool ParseTriangleTable(FILE* f, IVec3 triangle_table[60])
+static bool ParseTriangleTable(CsvReader* reader, void* data, s32 row)
 {
-	// The first line can optionally be a header, which we will skip.
-	// Otherwise rewind to the start of the file.
-	if (fscanf(f, "%*d,%*d,%*d\n") == 0) fscanf(f, "%*[^\n]\n");
-	else fseek(f, 0, SEEK_SET);
-
-	s32 idx = 0;
-	s32 fields_parsed;
-	IVec3 table[60];
-	// We will set id1 and id2 to -1 if we find them.
-	while (idx < ARRAYCOUNT(table) && (fields_parsed = fscanf(f, "%d,%d,%d\n", &table[idx].x, &table[idx].y, &table[idx].z)) == 3) ++idx;
-
-	if (idx == 60)
-	{
-		for (s32 i = 0; i < ARRAYCOUNT(table); ++i) triangle_table[i] = table[i];
-		return true;
-	}
-	else if (fields_parsed != EOF)
-	{
-		printf("Unable to parse triangle at index %d, is the line formatted correctly?\n", idx);
-		return false;
-	}
-	else return false;
+	IVec3* table = (IVec3*)data;
+	if (row >= 60) return CsvError(reader, reader->cursor, "expected 60 triangles, one for each symbol");
+	return CsvReadField(reader, &table[row].x) && CsvReadField(reader, &table[row].y) && CsvReadField(reader, &table[row].z);
 }
 
 /*
@@ -122,79 +193,62 @@ Parses the mapping from triangle index to symbol ID. The triangle index starts w
 counting up as we travel down and to the right. The bottom right corner is index 14. Then we start
 back towards the top with index 15, counting down and to the right again, and repeating.
 */
-bool ParseMapping2D(FILE* f, s32 output[64])
+static bool ParseMapping2D(CsvReader* reader, void* data, s32 row)
 {
-	// The first line can optionally be a header, which we will skip.
-	// Otherwise rewind to the start of the file.
-	if (fscanf(f, "%*d\n") == 0) fscanf(f, "%*[^\n]\n");
-	else fseek(f, 0, SEEK_SET);
-
-	s32 idx = 0;
-	s32 fields_parsed;
-	s32 table[64];
-	while (idx < ARRAYCOUNT(table) && (fields_parsed = fscanf(f, "%d\n", &table[idx]) == 1)) ++idx;
-
-	if (idx == 64)
-	{
-		for (s32 i = 0; i < ARRAYCOUNT(table); ++i) output[i] = table[i];
-		return true;
-	}
-	else if (fields_parsed != EOF)
-	{
-		printf("Unable to parse 2d mapping value at index %d, is the line formatted correctly?\n", idx);
-		return false;
-	}
-	else return false;
+	s32* table = (s32*)data;
+	if (row >= SUBDIVIDED_TRIANGLE_COUNT) return CsvError(reader, reader->cursor, "expected %d triangles", SUBDIVIDED_TRIANGLE_COUNT);
+	return CsvReadField(reader, &table[row]);
 }
 
 /*
-Looks through a CSV file containing vectors from the starmapping research, to find the two
-vectors corresponding to the given symbol IDs. To generate the CSV file, I used the arbitrary
+The vectors from the starmapping research, one per symbol. To generate the CSV file, I used the arbitrary
 IDs defined for each symbol, and hand-copied all the vectors into the file.
 
 You only need two starmapping vectors to compute the ball orientation,
-and any extras are used to verify the quality of the results.
+and any extras are used to verify the quality of the results (or to fit the orientation to all of them).
 */
-static bool FindStarmapVectors(FILE* f, s32 id1, s32 id2, Vec3* out_a, Vec3* out_b)
+struct Starmap
 {
-	// The first line can optionally be a header, which we will skip.
-	// Otherwise rewind to the start of the file.
-	if (fscanf(f, "%*d,%*lf,%*lf,%*lf\n") == 0) fscanf(f, "%*[^\n]\n");
-	else fseek(f, 0, SEEK_SET);
+	Vec3 vectors[60]; // Starmap vector for each symbol, indexed by symbol ID - 1.
+	bool has_vector[60]; // Whether the file had a vector for each symbol, indexed by symbol ID - 1.
+	s32 ids[60]; // Symbol IDs that have a vector, in the same order as the file.
+	s32 count;
+};
+
+// Gets the starmap vector for a symbol ID, or returns false if there isn't one.
+static bool GetStarmapVector(const Starmap& starmap, s32 id, Vec3* out)
+{
+	if (id < 1 || id > ARRAYCOUNT(starmap.vectors) || !starmap.has_vector[id - 1]) return false;
+	*out = starmap.vectors[id - 1];
+	return true;
+}
 
-	s32 parsed_count = 0;
-	s32 id, fields_parsed;
-	Vec3 v, a, b;
+/*
+Parses one vector from a starmap file, formatted as "Symbol ID,X,Y,Z". Each symbol can only have one vector.
+The first row can optionally be a header, which will be skipped.
+*/
+static bool ParseStarmap(CsvReader* reader, void* data, s32 row)
+{
+	Starmap* out = (Starmap*)data;
+	const char* id_start = reader->cursor;
+	s32 id;
+	Vec3 v;
+	if (!CsvReadField(reader, &id) || !CsvReadVec3(reader, &v)) return false;
+	if (id < 1 || id > ARRAYCOUNT(out->vectors) || out->has_vector[id - 1]) return CsvError(reader, id_start, "symbol ID %d is either invalid or used twice", id);
 
-	// We will set id1 and id2 to -1 if we find them.
-	while ((id1 >= 0 || id2 >= 0) && (fields_parsed = fscanf(f, "%d,%lf,%lf,%lf\n", &id, &v.x, &v.y, &v.z)) == 4)
-	{
-		if (id == id1)
-		{
-			id1 = -1;
-			a = v;
-		}
-		if (id == id2)
-		{
-			id2 = -1;
-			b = v;
-		}
-		++parsed_count;
-	}
+	out->vectors[id - 1] = v;
+	out->has_vector[id - 1] = true;
+	out->ids[out->count++] = id;
+	return true;
+}
 
-	// If we found both vectors, we are done! Otherwise, check for errors, and return false.
-	if (id1 < 0 && id2 < 0)
-	{
-		*out_a = a;
-		*out_b = b;
-		return true;
-	}
-	else if (fields_parsed != EOF)
-	{
-		printf("Unable to parse starmap vector at index %d, is the line formatted correctly?\n", parsed_count);
-		return false;
-	}
-	else return false;
+// Loads a starmap file, see ParseStarmap(). Returns true if successful.
+bool LoadStarmap(const char* starmap_path, Starmap* out)
+{
+	// The rows have to go in order, so the IDs end up in the same order as the file.
+	*out = {};
+	s32 row_count;
+	return LoadCsv(starmap_path, ParseStarmap, NoCsvAllocation, out, &row_count, nullptr);
 }
 
 // Gets two barycentric coordinates of a point p, on a triangle formed by v0, v1, and v2.
@@ -209,6 +263,17 @@ Vec2 CartesianToBarycentric(Vec3 p, Vec3 v0, Vec3 v1, Vec3 v2)
 	return Vec2(Dot(-v0, h), Dot(p, Cross(-v0, e1))) * (1.0 / a);
 }
 
+// Same as the other CartesianToBarycentric(), but using a precomputed face.
+Vec2 CartesianToBarycentric(Vec3 p, const Face& face)
+{
+	double w0 = Dot(face.inv_basis[0], p);
+	double w1 = Dot(face.inv_basis[1], p);
+	double w2 = Dot(face.inv_basis[2], p);
+	double sum = w0 + w1 + w2;
+	if (sum > -EPSILON && sum < EPSILON) assert(false);
+	return Vec2(w1, w2) * (1.0 / sum);
+}
+
 // Converts barycentric coordinates into cartesian coordinates.
 // The expected barycentric coordinates are the same components and
 // in the same order as you would receive from CartesianToBarycentric().
@@ -217,79 +282,115 @@ Vec3 BarycentricToCartesian(Vec2 bary, Vec3 v0, Vec3 v1, Vec3 v2)
 	return v1 * bary.u + v2 * bary.v + v0 * (1.0 - bary.u - bary.v);
 }
 
-// A lookup table to convert from one somewhat arbitrary indexing of subdivided triangles into the three vertices
-// that form the triangle.
-IVec3 bary_lut[] = {
-	{0, 1, 9},
-	{10, 9, 1},
-	{10, 2, 1},
-	{11, 10, 2},
-	{2, 3, 11},
-	{12, 11, 3},
-	{3, 4, 12},
-	{13, 2, 4},
-	{4, 5, 13},
-	{14, 13, 5},
-	{5, 6, 14},
-	{15, 14, 6},
-	{6, 7, 15},
-	{16, 15, 7},
-	{7, 8, 16},
-	{9, 10, 17},
-	{18, 17, 10},
-	{10, 11, 18},
-	{19, 18, 11},
-	{11, 12, 19},
-	{20, 19, 12},
-	{12, 13, 20},
-	{21, 20, 13},
-	{13, 14, 21},
-	{22, 21, 14},
-	{14, 15, 22},
-	{23, 22, 15},
-	{15, 16, 23},
-	{17, 18, 24},
-	{25, 24, 18},
-	{18, 19, 25},
-	{26, 25, 19},
-	{19, 20, 26},
-	{27, 26, 20},
-	{20, 21, 27},
-	{28, 27, 21},
-	{21, 22, 28},
-	{29, 28, 22},
-	{22, 23, 29},
-	{24, 25, 30},
-	{31, 30, 25},
-	{25, 26, 31},
-	{32, 31, 26},
-	{26, 27, 32},
-	{33, 32, 27},
-	{27, 28, 33},
-	{34, 33, 28},
-	{28, 29, 34},
-	{30, 31, 35},
-	{36, 35, 31},
-	{31, 32, 36},
-	{37, 36, 32},
-	{32, 33, 37},
-	{38, 37, 33},
-	{33, 34, 38},
-	{35, 36, 39},
-	{40, 39, 36},
-	{36, 37, 40},
-	{41, 40, 37},
-	{37, 38, 41},
-	{39, 40, 42},
-	{43, 42, 40},
-	{40, 41, 43},
-	{42, 43, 44}};
-
-/*
-Subdivides a triangle formed by v0, v1, and v2 into 64 smaller ones,
+/*
+Lookup tables for a triangle subdivided into Factor * Factor smaller ones, generated at compile time by GenerateSubdivisionTables().
+
+The vertices are numbered the same way SubdivideTriangle() creates them: row by row along the v axis, and along the u axis
+within each row, so vertex (u, v) has index v * (Factor + 1) - v * (v - 1) / 2 + u. The triangles are numbered the same way
+as ParseMapping2D() expects, one row at a time, alternating between upright and upside down triangles.
+
+triangles converts from the triangle index into the three vertices that form the triangle. Upright triangles start
+with their lowest corner, and upside down triangles start with their highest corner, so they are "rotated" halfway around.
+corners is the same thing, but with each vertex as its (u, v) grid coordinates instead of its index.
+
+digits is the inverse, used by SolveViaInterpolation(). It goes from the barycentric indices of a subdivided triangle
+(each taken modulo the factor) straight to the triangle index. Combinations that can't happen are set to -1.
+*/
+template <s32 Factor>
+struct SubdivisionTables
+{
+	static constexpr s32 vertex_count = (Factor + 1) * (Factor + 2) / 2;
+	static constexpr s32 triangle_count = Factor * Factor;
+
+	s32 triangles[triangle_count][3];
+	s8 corners[triangle_count][3][2];
+	s16 digits[Factor][Factor][Factor];
+};
+
+template <s32 Factor>
+constexpr s32 GetSubdividedVertexIndex(s32 u, s32 v)
+{
+	return v * (Factor + 1) - v * (v - 1) / 2 + u;
+}
+
+// Index of the upright triangle at (u, v). The upside down triangle to the right of it (if there is one) is the next index.
+template <s32 Factor>
+constexpr s32 GetSubdividedTriangleIndex(s32 u, s32 v)
+{
+	return v * (2 * Factor - v) + 2 * u;
+}
+
+template <s32 Factor>
+constexpr SubdivisionTables<Factor> GenerateSubdivisionTables()
+{
+	SubdivisionTables<Factor> tables = {};
+	for (s32 v = 0; v < Factor; ++v)
+	{
+		for (s32 u = 0; u < Factor - v; ++u)
+		{
+			s32 tri = GetSubdividedTriangleIndex<Factor>(u, v);
+			s32 upright[3][2] = {{u, v}, {u + 1, v}, {u, v + 1}};
+			for (s32 i = 0; i < 3; ++i)
+			{
+				tables.triangles[tri][i] = GetSubdividedVertexIndex<Factor>(upright[i][0], upright[i][1]);
+				tables.corners[tri][i][0] = (s8)upright[i][0];
+				tables.corners[tri][i][1] = (s8)upright[i][1];
+			}
+			if (u + 1 < Factor - v)
+			{
+				s32 upside_down[3][2] = {{u + 1, v + 1}, {u, v + 1}, {u + 1, v}};
+				for (s32 i = 0; i < 3; ++i)
+				{
+					tables.triangles[tri + 1][i] = GetSubdividedVertexIndex<Factor>(upside_down[i][0], upside_down[i][1]);
+					tables.corners[tri + 1][i][0] = (s8)upside_down[i][0];
+					tables.corners[tri + 1][i][1] = (s8)upside_down[i][1];
+				}
+			}
+		}
+	}
+
+	// If the indices add up to the factor or more, the triangle lies outside our larger triangle, and we convert to the
+	// corresponding indices in the next one (don't ask me why this works). After that, the indices add up to one less
+	// than the factor for upright triangles, or two less for upside down ones.
+	for (s32 x = 0; x < Factor; ++x)
+	{
+		for (s32 y = 0; y < Factor; ++y)
+		{
+			for (s32 z = 0; z < Factor; ++z)
+			{
+				s32 u = x;
+				s32 v = y;
+				s32 sum = x + y + z;
+				if (sum >= Factor)
+				{
+					u = Factor - 1 - x;
+					v = Factor - 1 - y;
+					sum = 3 * (Factor - 1) - sum;
+				}
+
+				s32 tri = -1;
+				if (sum == Factor - 1) tri = GetSubdividedTriangleIndex<Factor>(u, v);
+				else if (sum == Factor - 2) tri = GetSubdividedTriangleIndex<Factor>(u, v) + 1;
+				tables.digits[x][y][z] = (s16)tri;
+			}
+		}
+	}
+	return tables;
+}
+
+// Lookup tables for every subdivision factor we use, built at compile time. The solvers all use SUBDIVISION_AMOUNT's,
+// except for SolveViaFixedPoint(), which can be instantiated for others.
+template <s32 Factor>
+static constexpr SubdivisionTables<Factor> subdivision_tables = GenerateSubdivisionTables<Factor>();
+
+static_assert(SubdivisionTables<SUBDIVISION_AMOUNT>::vertex_count == SUBDIVIDED_VERTEX_COUNT, "Subdivided vertex count doesn't match the tables.");
+static_assert(SubdivisionTables<SUBDIVISION_AMOUNT>::triangle_count == SUBDIVIDED_TRIANGLE_COUNT, "Subdivided triangle count doesn't match the tables.");
+
+/*
+Subdivides a triangle formed by v0, v1, and v2 into 64 smaller ones (or however many the subdivision amount gives us),
 placing the 45 vertices which compose it into the output.
 */
-bool SubdivideTriangle(Vec3 v0, Vec3 v1, Vec3 v2, Vec3 out_vertices[45])
+bool SubdivideTriangle(Vec3 v0, Vec3 v1, Vec3 v2, Vec3 out_vertices[SUBDIVIDED_VERTEX_COUNT])
 {
 	s32 count = 0;
 	for (s32 j = 0; j <= SUBDIVISION_AMOUNT; ++j)
@@ -299,13 +400,13 @@ bool SubdivideTriangle(Vec3 v0, Vec3 v1, Vec3 v2, Vec3 out_vertices[45])
 			Vec2 bary = Vec2(i, j) * (1.0 / SUBDIVISION_AMOUNT);
 			if (bary.u + bary.v <= 1.0)
 			{
-				if (++count > 45) break;
+				if (++count > SUBDIVIDED_VERTEX_COUNT) break;
 				Vec3 out = BarycentricToCartesian(bary, v0, v1, v2);
 				out_vertices[count - 1] = out;
 			}
 		}
 	}
-	if (count == 45) return true;
+	if (count == SUBDIVIDED_VERTEX_COUNT) return true;
 	else
 	{
 		printf("Tried to subdivide face, but did not get the right number of vertices.\n");
@@ -313,45 +414,178 @@ bool SubdivideTriangle(Vec3 v0, Vec3 v1, Vec3 v2, Vec3 out_vertices[45])
 	}
 }
 
+// Number of triangles in SubdividedTriangles, rounded up so that the SIMD raycast can always load a full register.
+#define SUBDIVIDED_TRIANGLE_STRIDE ((SUBDIVIDED_TRIANGLE_COUNT + 7) & ~7)
+
 /*
-Finds which triangle in a subdivided one intersects the desired vector, by raycasting.
+The subdivided triangles for one level of SolveViaRaycast(), copied out of the vertex list into a separate array
+for each coordinate, so that the SIMD raycast can load several triangles at once. We store the two edges instead of
+the other two vertices, since that's what the raycast needs. The padding triangles at the end are all zeroes,
+which can never be hit.
 */
-bool FindIntersectedTriangle(Vec3 desired, Vec3 subdivided_vertices[45], IVec3* result, s32* out_idx)
+struct alignas(64) SubdividedTriangles
 {
-	for (s32 i = 0; i < ARRAYCOUNT(bary_lut); ++i)
-	{
-		Vec3 v0 = subdivided_vertices[bary_lut[i].x];
-		Vec3 v1 = subdivided_vertices[bary_lut[i].y];
-		Vec3 v2 = subdivided_vertices[bary_lut[i].z];
+	double v0[3][SUBDIVIDED_TRIANGLE_STRIDE];
+	double e1[3][SUBDIVIDED_TRIANGLE_STRIDE];
+	double e2[3][SUBDIVIDED_TRIANGLE_STRIDE];
+};
 
-		Vec3 out = {};
-		Vec2 out_bary = {};
-		bool does_intersect = RayTriangleIntersect(Normalize(desired), v0, v1, v2, &out, &out_bary.u, &out_bary.v);
-		if (does_intersect)
+static void BuildSubdividedTriangles(const Vec3 subdivided_vertices[SUBDIVIDED_VERTEX_COUNT], SubdividedTriangles* out)
+{
+	for (s32 i = 0; i < SUBDIVIDED_TRIANGLE_STRIDE; ++i)
+	{
+		Vec3 v0 = {}, e1 = {}, e2 = {};
+		if (i < SUBDIVIDED_TRIANGLE_COUNT)
 		{
-			printf("Intersection found with subdivided triangle idx %d:\nV0: (%.15f, %.15f, %.15f)\nV1: (%.15f, %.15f, %.15f)\nV2: (%.15f, %.15f, %.15f)\n", i, v0.x, v0.y, v0.z, v1.x, v1.y, v1.z, v2.x, v2.y, v2.z);
-			printf("Intersection Point: (%.15f, %.15f, %.15f), U=%.15f, V=%.15f\n", out.x, out.y, out.z, out_bary.u, out_bary.v);
-			out = Normalize(out);
-			printf("Normalized: (%.15f, %.15f, %.15f)\n", out.x, out.y, out.z);
-			*result = bary_lut[i];
-			*out_idx = i;
-			return true;
+			const s32* tri = subdivision_tables<SUBDIVISION_AMOUNT>.triangles[i];
+			v0 = subdivided_vertices[tri[0]];
+			e1 = subdivided_vertices[tri[1]] - v0;
+			e2 = subdivided_vertices[tri[2]] - v0;
+		}
+		for (s32 axis = 0; axis < 3; ++axis)
+		{
+			out->v0[axis][i] = v0[axis];
+			out->e1[axis][i] = e1[axis];
+			out->e2[axis][i] = e2[axis];
 		}
 	}
-	return false;
 }
 
+/*
+Raycasts against all the subdivided triangles, returning the index of the first one we hit, or -1 if we missed them all.
+This is exactly the same math as RayTriangleIntersect(), but with AVX it tests 4 triangles at a time (or 8 with AVX-512).
+The direction should be normalized.
+*/
+static s32 IntersectSubdividedTriangles(Vec3 d, const SubdividedTriangles& tris)
+{
+#if defined(__AVX512F__)
+	const __m512d dx = _mm512_set1_pd(d.x), dy = _mm512_set1_pd(d.y), dz = _mm512_set1_pd(d.z);
+	const __m512d zero = _mm512_setzero_pd(), one = _mm512_set1_pd(1.0);
+	const __m512d epsilon = _mm512_set1_pd(EPSILON), neg_epsilon = _mm512_set1_pd(-EPSILON);
+	for (s32 i = 0; i < SUBDIVIDED_TRIANGLE_STRIDE; i += 8)
+	{
+		__m512d sx = _mm512_sub_pd(zero, _mm512_load_pd(&tris.v0[0][i]));
+		__m512d sy = _mm512_sub_pd(zero, _mm512_load_pd(&tris.v0[1][i]));
+		__m512d sz = _mm512_sub_pd(zero, _mm512_load_pd(&tris.v0[2][i]));
+		__m512d e1x = _mm512_load_pd(&tris.e1[0][i]), e1y = _mm512_load_pd(&tris.e1[1][i]), e1z = _mm512_load_pd(&tris.e1[2][i]);
+		__m512d e2x = _mm512_load_pd(&tris.e2[0][i]), e2y = _mm512_load_pd(&tris.e2[1][i]), e2z = _mm512_load_pd(&tris.e2[2][i]);
+
+		// h = Cross(d, e2), a = Dot(e1, h)
+		__m512d hx = _mm512_sub_pd(_mm512_mul_pd(dy, e2z), _mm512_mul_pd(dz, e2y));
+		__m512d hy = _mm512_sub_pd(_mm512_mul_pd(dz, e2x), _mm512_mul_pd(dx, e2z));
+		__m512d hz = _mm512_sub_pd(_mm512_mul_pd(dx, e2y), _mm512_mul_pd(dy, e2x));
+		__m512d a = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(e1x, hx), _mm512_mul_pd(e1y, hy)), _mm512_mul_pd(e1z, hz));
+		__m512d f = _mm512_div_pd(one, a);
+
+		// u = f * Dot(s, h), where s = -v0
+		__m512d u = _mm512_mul_pd(f, _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(sx, hx), _mm512_mul_pd(sy, hy)), _mm512_mul_pd(sz, hz)));
+
+		// q = Cross(s, e1), v = f * Dot(d, q), t = f * Dot(e2, q)
+		__m512d qx = _mm512_sub_pd(_mm512_mul_pd(sy, e1z), _mm512_mul_pd(sz, e1y));
+		__m512d qy = _mm512_sub_pd(_mm512_mul_pd(sz, e1x), _mm512_mul_pd(sx, e1z));
+		__m512d qz = _mm512_sub_pd(_mm512_mul_pd(sx, e1y), _mm512_mul_pd(sy, e1x));
+		__m512d v = _mm512_mul_pd(f, _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(dx, qx), _mm512_mul_pd(dy, qy)), _mm512_mul_pd(dz, qz)));
+		__m512d t = _mm512_mul_pd(f, _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(e2x, qx), _mm512_mul_pd(e2y, qy)), _mm512_mul_pd(e2z, qz)));
+
+		__mmask8 hit = _mm512_cmp_pd_mask(a, neg_epsilon, _CMP_LE_OQ) | _mm512_cmp_pd_mask(a, epsilon, _CMP_GE_OQ);
+		hit &= _mm512_cmp_pd_mask(u, zero, _CMP_GE_OQ) & _mm512_cmp_pd_mask(u, one, _CMP_LE_OQ);
+		hit &= _mm512_cmp_pd_mask(v, zero, _CMP_GE_OQ) & _mm512_cmp_pd_mask(_mm512_add_pd(u, v), one, _CMP_LE_OQ);
+		hit &= _mm512_cmp_pd_mask(t, epsilon, _CMP_GT_OQ);
+		if (hit) return i + FirstSetBit(hit);
+	}
+	return -1;
+#elif defined(__AVX2__)
+	const __m256d dx = _mm256_set1_pd(d.x), dy = _mm256_set1_pd(d.y), dz = _mm256_set1_pd(d.z);
+	const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0);
+	const __m256d epsilon = _mm256_set1_pd(EPSILON), neg_epsilon = _mm256_set1_pd(-EPSILON);
+	for (s32 i = 0; i < SUBDIVIDED_TRIANGLE_STRIDE; i += 4)
+	{
+		__m256d sx = _mm256_sub_pd(zero, _mm256_load_pd(&tris.v0[0][i]));
+		__m256d sy = _mm256_sub_pd(zero, _mm256_load_pd(&tris.v0[1][i]));
+		__m256d sz = _mm256_sub_pd(zero, _mm256_load_pd(&tris.v0[2][i]));
+		__m256d e1x = _mm256_load_pd(&tris.e1[0][i]), e1y = _mm256_load_pd(&tris.e1[1][i]), e1z = _mm256_load_pd(&tris.e1[2][i]);
+		__m256d e2x = _mm256_load_pd(&tris.e2[0][i]), e2y = _mm256_load_pd(&tris.e2[1][i]), e2z = _mm256_load_pd(&tris.e2[2][i]);
+
+		// h = Cross(d, e2), a = Dot(e1, h)
+		__m256d hx = _mm256_sub_pd(_mm256_mul_pd(dy, e2z), _mm256_mul_pd(dz, e2y));
+		__m256d hy = _mm256_sub_pd(_mm256_mul_pd(dz, e2x), _mm256_mul_pd(dx, e2z));
+		__m256d hz = _mm256_sub_pd(_mm256_mul_pd(dx, e2y), _mm256_mul_pd(dy, e2x));
+		__m256d a = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(e1x, hx), _mm256_mul_pd(e1y, hy)), _mm256_mul_pd(e1z, hz));
+		__m256d f = _mm256_div_pd(one, a);
+
+		// u = f * Dot(s, h), where s = -v0
+		__m256d u = _mm256_mul_pd(f, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(sx, hx), _mm256_mul_pd(sy, hy)), _mm256_mul_pd(sz, hz)));
+
+		// q = Cross(s, e1), v = f * Dot(d, q), t = f * Dot(e2, q)
+		__m256d qx = _mm256_sub_pd(_mm256_mul_pd(sy, e1z), _mm256_mul_pd(sz, e1y));
+		__m256d qy = _mm256_sub_pd(_mm256_mul_pd(sz, e1x), _mm256_mul_pd(sx, e1z));
+		__m256d qz = _mm256_sub_pd(_mm256_mul_pd(sx, e1y), _mm256_mul_pd(sy, e1x));
+		__m256d v = _mm256_mul_pd(f, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, qx), _mm256_mul_pd(dy, qy)), _mm256_mul_pd(dz, qz)));
+		__m256d t = _mm256_mul_pd(f, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(e2x, qx), _mm256_mul_pd(e2y, qy)), _mm256_mul_pd(e2z, qz)));
+
+		__m256d hit = _mm256_or_pd(_mm256_cmp_pd(a, neg_epsilon, _CMP_LE_OQ), _mm256_cmp_pd(a, epsilon, _CMP_GE_OQ));
+		hit = _mm256_and_pd(hit, _mm256_and_pd(_mm256_cmp_pd(u, zero, _CMP_GE_OQ), _mm256_cmp_pd(u, one, _CMP_LE_OQ)));
+		hit = _mm256_and_pd(hit, _mm256_and_pd(_mm256_cmp_pd(v, zero, _CMP_GE_OQ), _mm256_cmp_pd(_mm256_add_pd(u, v), one, _CMP_LE_OQ)));
+		hit = _mm256_and_pd(hit, _mm256_cmp_pd(t, epsilon, _CMP_GT_OQ));
+		s32 mask = _mm256_movemask_pd(hit);
+		if (mask) return i + FirstSetBit(mask);
+	}
+	return -1;
+#else
+	for (s32 i = 0; i < SUBDIVIDED_TRIANGLE_COUNT; ++i)
+	{
+		Vec3 v0 = Vec3(tris.v0[0][i], tris.v0[1][i], tris.v0[2][i]);
+		Vec3 e1 = Vec3(tris.e1[0][i], tris.e1[1][i], tris.e1[2][i]);
+		Vec3 e2 = Vec3(tris.e2[0][i], tris.e2[1][i], tris.e2[2][i]);
+		if (RayTriangleIntersect(d, v0, v0 + e1, v0 + e2, nullptr, nullptr, nullptr)) return i;
+	}
+	return -1;
+#endif
+}
+
+/*
+Finds which triangle in a subdivided one intersects the desired vector, by raycasting.
+The desired vector should be normalized.
+*/
+bool FindIntersectedTriangle(Vec3 desired, Vec3 subdivided_vertices[SUBDIVIDED_VERTEX_COUNT], IVec3* result, s32* out_idx)
+{
+	SubdividedTriangles tris;
+	BuildSubdividedTriangles(subdivided_vertices, &tris);
+	s32 i = IntersectSubdividedTriangles(desired, tris);
+	if (i < 0) return false;
+
+	const s32* tri = subdivision_tables<SUBDIVISION_AMOUNT>.triangles[i];
+	TRACE(TRACE_DESCENT, TRACE_STAGE, "Intersection found with subdivided triangle idx %d", i);
+	if (TraceWanted(TRACE_DESCENT, TRACE_DETAIL))
+	{
+		Vec3 v0 = subdivided_vertices[tri[0]];
+		Vec3 v1 = subdivided_vertices[tri[1]];
+		Vec3 v2 = subdivided_vertices[tri[2]];
+		Vec3 out = {};
+		Vec2 out_bary = {};
+		RayTriangleIntersect(desired, v0, v1, v2, &out, &out_bary.u, &out_bary.v);
+		TRACE(TRACE_DESCENT, TRACE_DETAIL, "V0: (%.15f, %.15f, %.15f)", v0.x, v0.y, v0.z);
+		TRACE(TRACE_DESCENT, TRACE_DETAIL, "V1: (%.15f, %.15f, %.15f)", v1.x, v1.y, v1.z);
+		TRACE(TRACE_DESCENT, TRACE_DETAIL, "V2: (%.15f, %.15f, %.15f)", v2.x, v2.y, v2.z);
+		TRACE(TRACE_DESCENT, TRACE_DETAIL, "Intersection Point: (%.15f, %.15f, %.15f), U=%.15f, V=%.15f", out.x, out.y, out.z, out_bary.u, out_bary.v);
+		out = Normalize(out);
+		TRACE(TRACE_DESCENT, TRACE_DETAIL, "Normalized: (%.15f, %.15f, %.15f)", out.x, out.y, out.z);
+	}
+	*result = IVec3(tri[0], tri[1], tri[2]);
+	*out_idx = i;
+	return true;
+}
 
 /*
 Solves the last 7 symbols in the combination by raycasting against each subdivided triangle, subdividing the hit triangle,
 and repeating.
 */
-bool SolveViaRaycast(Vec3 desired, Vec3 v0, Vec3 v1, Vec3 v2, IVec3 triangle_table[60], s32 out_indices[SUBDIVISION_COUNT])
+bool SolveViaRaycast(Vec3 desired, const Face& face, s32 out_indices[SUBDIVISION_COUNT])
 {	
 	IVec3 indices = {};
 	s32 count = 0;
-	Vec3 subdivided_vertices[45] = {};
-	if (!SubdivideTriangle(v0, v1, v2, subdivided_vertices))
+	Vec3 subdivided_vertices[SUBDIVIDED_VERTEX_COUNT] = {};
+	if (!SubdivideTriangle(face.v0, face.v1, face.v2, subdivided_vertices))
 	{
 		printf("Unable to subdivide triangle, aborting!\n");
 		return false;
@@ -359,11 +593,13 @@ bool SolveViaRaycast(Vec3 desired, Vec3 v0, Vec3 v1, Vec3 v2, IVec3 triangle_tab
 
 	s32 i;
 	s32 output_idx = 0;
-	while (count++ < SUBDIVISION_COUNT && FindIntersectedTriangle(desired, subdivided_vertices, &indices, &i))
+	Vec3 d = Normalize(desired);
+	s64 level_start = StartMetricsTimer();
+	while (count++ < SUBDIVISION_COUNT && FindIntersectedTriangle(d, subdivided_vertices, &indices, &i))
 	{
-		v0 = subdivided_vertices[indices.x];
-		v1 = subdivided_vertices[indices.y];
-		v2 = subdivided_vertices[indices.z];
+		Vec3 v0 = subdivided_vertices[indices.x];
+		Vec3 v1 = subdivided_vertices[indices.y];
+		Vec3 v2 = subdivided_vertices[indices.z];
 
 		out_indices[output_idx++] = i;
 		if (!SubdivideTriangle(v0, v1, v2, subdivided_vertices))
@@ -371,6 +607,8 @@ bool SolveViaRaycast(Vec3 desired, Vec3 v0, Vec3 v1, Vec3 v2, IVec3 triangle_tab
 			printf("Unable to subdivide triangle, aborting!\n");
 			return false;
 		}
+		RecordLevelLatency(output_idx - 1, level_start);
+		level_start = StartMetricsTimer();
 	}
 	return true;
 }
@@ -379,15 +617,15 @@ bool SolveViaRaycast(Vec3 desired, Vec3 v0, Vec3 v1, Vec3 v2, IVec3 triangle_tab
 Solves the last 7 symbols of the combination by finding the barycentric coordinates of the desired vector,
 and computing which triangle it falls in at each subdivision level.
 */
-bool SolveViaInterpolation(Vec3 desired, Vec3 v0, Vec3 v1, Vec3 v2, s32 out_indices[SUBDIVISION_COUNT])
+bool SolveViaInterpolation(Vec3 desired, const Face& face, s32 out_indices[SUBDIVISION_COUNT])
 {
-	// Subdivide the triangle 7 times, splitting by 8 each time.
+	// Subdivide the triangle 7 times, splitting by 8 each time (or whatever the subdivision count and amount are).
 	s32 subdivisions = SUBDIVISION_AMOUNT;
 	for (s32 i = 1; i < SUBDIVISION_COUNT; ++i) subdivisions *= SUBDIVISION_AMOUNT;
 
 	// Compute the barycentric coordinates of our desired point within the triangle.
-	Vec2 bary = CartesianToBarycentric(desired, v0, v1, v2);
-	printf("Computed Barycentric Coordinates: (%.15f, %.15f, %.15f)\n", bary.u, bary.v, 1.0 - bary.u - bary.v);
+	Vec2 bary = CartesianToBarycentric(desired, face);
+	TRACE(TRACE_DESCENT, TRACE_DETAIL, "Computed Barycentric Coordinates: (%.15f, %.15f, %.15f)", bary.u, bary.v, 1.0 - bary.u - bary.v);
 	if (bary.u + bary.v > 1.0)
 	{
 		printf("Desired point seems to lie outside the provided face, aborting!\n");
@@ -396,20 +634,23 @@ bool SolveViaInterpolation(Vec3 desired, Vec3 v0, Vec3 v1, Vec3 v2, s32 out_indi
 
 	// Convert to a 3D index, by scaling to the number of subdivisions and rounding down.
 	IVec3 rounded_bary = IVec3((s32)(bary.u * subdivisions), (s32)(bary.v * subdivisions), (s32)((1.0 - bary.u - bary.v) * subdivisions));
-	printf("Rounded down to nearest subdivision: (%d, %d, %d)\n", rounded_bary.x, rounded_bary.y, rounded_bary.z);
+	TRACE(TRACE_DESCENT, TRACE_DETAIL, "Rounded down to nearest subdivision: (%d, %d, %d)", rounded_bary.x, rounded_bary.y, rounded_bary.z);
 
 	IVec3 current_bary = rounded_bary;
 	s32 current_divisions = subdivisions;
 	s32 output_idx = SUBDIVISION_COUNT - 1;
 	for (s32 i = 0; i < SUBDIVISION_COUNT; ++i)
 	{
+		s64 level_start = StartMetricsTimer();
 		Vec2 r0, r1, r2;
 		double inc = 1.0 / current_divisions; // Increment amount.
-		current_divisions /= 8; // Move out one subdivision level.
+		bool upside_down = (current_bary.x + current_bary.y + current_bary.z == current_divisions - 2);
+		current_divisions /= SUBDIVISION_AMOUNT; // Move out one subdivision level.
 
 		// Half of the triangles are upside down, so we need to reorient/reorder the vertices.
-		// If the indices add up to an even number, we know our triangle is upside down (don't ask me why this is true).
-		if ((current_bary.x + current_bary.y + current_bary.z) % 2 == 0)
+		// Rounding down each index loses less than one from each, and they add up to one less than the number of divisions
+		// for upright triangles, or two less for upside down ones.
+		if (upside_down)
 		{
 			r0 = Vec2(current_bary.x + 1, current_bary.y + 1) * inc;
 			r1 = Vec2(current_bary.x, current_bary.y + 1) * inc;
@@ -423,134 +664,357 @@ bool SolveViaInterpolation(Vec3 desired, Vec3 v0, Vec3 v1, Vec3 v2, s32 out_indi
 		}
 
 		// Get the cartesian coordinates of the triangle vertices, just to raycast against as a sanity check.
-		Vec3 out_v0 = BarycentricToCartesian(r0, v0, v1, v2);
-		Vec3 out_v1 = BarycentricToCartesian(r1, v0, v1, v2);
-		Vec3 out_v2 = BarycentricToCartesian(r2, v0, v1, v2);
-
-		Vec3 intersection = {};
-		Vec2 intersection_bary = {};
-		bool does_intersect = RayTriangleIntersect(Normalize(desired), out_v0, out_v1, out_v2, &intersection, &intersection_bary.u, &intersection_bary.v);
-
-		// Find our barycentric index at this subdivision level. The resulting subdivided triangle can lie outside our larger triangle.
-		// If this happens, we can convert to the corresponding index in the next triangle, by adding 1 to each component and subtracting from 8.
-		// Do not ask me why this works.
-		IVec3 local_bary = IVec3(current_bary.x % SUBDIVISION_AMOUNT, current_bary.y % SUBDIVISION_AMOUNT, current_bary.z % SUBDIVISION_AMOUNT);
-		if (local_bary.x + local_bary.y + local_bary.z > SUBDIVISION_AMOUNT) local_bary = Vec3(SUBDIVISION_AMOUNT) - Vec3((local_bary + IVec3(1, 1, 1)));
-		printf("Triangle Indices: (%d, %d, %d) (Does Intersect? %s)\n", local_bary.x, local_bary.y, local_bary.z, does_intersect ? "Yes" : "No");
-		current_bary /= SUBDIVISION_AMOUNT;
-
-		// Convert our barycentric indices to a triangle index in our arbitrary scheme. We want to find the index of the "top" vertex.
-		// In many cases, this vertex is shared between two triangles. By default we will use the second triangle in the list if this
-		// happens, unless this is an upside down triangle, in which case we prefer the first.
-		bool use_first = false;
-
-		// For upside down triangles, set the "use first" flag, and offset accordingly.
-		if ((local_bary.x + local_bary.y + local_bary.z) % 2 == 0)
+		// Nothing uses the answer except the trace and metrics, so we only bother when one of them wants it.
+		bool does_intersect = false;
+		if (TraceWanted(TRACE_DESCENT, TRACE_STAGE) || metrics_enabled)
 		{
-			local_bary.x += 1;
-			local_bary.y += 1;
-			use_first = true;
+			Vec3 out_v0 = BarycentricToCartesian(r0, face.v0, face.v1, face.v2);
+			Vec3 out_v1 = BarycentricToCartesian(r1, face.v0, face.v1, face.v2);
+			Vec3 out_v2 = BarycentricToCartesian(r2, face.v0, face.v1, face.v2);
+
+			Vec3 intersection = {};
+			Vec2 intersection_bary = {};
+			does_intersect = RayTriangleIntersect(Normalize(desired), out_v0, out_v1, out_v2, &intersection, &intersection_bary.u, &intersection_bary.v);
+			if (!does_intersect) CountMetric(METRIC_DISAGREEMENTS);
 		}
 
-		// Since this is a triangle, each level up has one fewer vertices than the previous.
-		// To index in the Y axis, we add 9, then 8, then 7, etc.
-		// For example, if our 2D vertex was (3, 4), then the linear index is (3) + (9 + 8 + 7 + 6).
-		s32 idx = local_bary.x;
-		s32 start = 9;
-		for (s32 j = 0; j < local_bary.y; ++j)
-		{
-			idx += (start - j);
-		}
-
-		// Use our barycentric lookup table to find the triangle index using our linear vertex index,
-		// accounting for the "use first" flag mentioned above.
-		s32 tri1 = -1;
-		s32 tri2 = -1;
-		for (s32 j = 0; j < ARRAYCOUNT(bary_lut); ++j)
+		// Find the triangle index at this subdivision level. The barycentric indices modulo the subdivision amount
+		// tell us where we are inside the larger triangle, and the digit table turns that straight into an index.
+		IVec3 local_bary = IVec3(current_bary.x % SUBDIVISION_AMOUNT, current_bary.y % SUBDIVISION_AMOUNT, current_bary.z % SUBDIVISION_AMOUNT);
+		s32 tri = subdivision_tables<SUBDIVISION_AMOUNT>.digits[local_bary.x][local_bary.y][local_bary.z];
+		TRACE(TRACE_DESCENT, TRACE_STAGE, "Triangle Indices: (%d, %d, %d) -> %d (Does Intersect? %s)", local_bary.x, local_bary.y, local_bary.z, tri, does_intersect ? "Yes" : "No");
+		current_bary /= SUBDIVISION_AMOUNT;
+		if (tri < 0)
 		{
-			if (idx == bary_lut[j].x)
-			{
-				if (tri1 >= 0) tri2 = j;
-				else tri1 = j;
-			}
+			printf("Barycentric indices (%d, %d, %d) don't form a triangle, something went wrong!\n", local_bary.x, local_bary.y, local_bary.z);
+			return false;
 		}
-		if (!use_first && tri1 >= 0 && tri2 >= 0) tri1 = tri2;
 
-		if (output_idx >= 0) out_indices[output_idx--] = tri1;
+		if (output_idx >= 0) out_indices[output_idx--] = tri;
 		else
 		{
 			printf("We found too many triangle indices, something went wrong!\n");
 			return false;
 		}
+
+		// This goes from the finest level up, so the levels are backwards here.
+		RecordLevelLatency(SUBDIVISION_COUNT - 1 - i, level_start);
 	}
 
 	return true;
 }
 
-/*
-Solves the orientation of our ball in space given two known vectors from starmapping research.
-Uses the resulting ball to compute the first symbol, and then uses the triangular face for that
-symbol to compute the remaining 7, with two methods. You will need to build three mapping files yourself:
+template <s32 Factor, s32 Level>
+constexpr s64 GetSubdivisionPower()
+{
+	s64 power = 1;
+	for (s32 i = 0; i < Level; ++i) power *= Factor;
+	return power;
+}
 
-One is way to map each symbol to one vertex of an icosahedron, and two vertices of a dodecahedron.
-Another maps each symbol to a triangle subdivided into 64 smaller ones, using the indexing scheme from ParseMapping2D().
-The remaining file is just a list of vectors from starmapping research, and their corresponding symbol IDs.
+template <s32 Factor>
+constexpr s32 GetSubdivisionBits()
+{
+	s32 bits = 0;
+	while ((1 << bits) < Factor) ++bits;
+	return ((1 << bits) == Factor) ? bits : -1;
+}
 
-I created the first two mappings using various paint programs, with Blender and UE4 to visualize and create the 3D map.
+/*
+Triangle index at one level of the fixed point barycentric indices, where level 0 is the finest. When the factor is a power
+of two, each level is just a few bits, so it's a shift and a mask. Otherwise it's a divide and a modulo by constants,
+which the compiler turns into multiplies anyway.
 */
-s32 SolveRotation(s32 id1, s32 id2, Vec3 desired, const char* mapping_3d_path, const char* starmap_path, const char* mapping_2d_path)
+template <s32 Factor, s32 Level>
+inline s32 GetSubdivisionDigit(s64 x, s64 y, s64 z)
 {
-	// Load the starmap file and scan it for two vectors corresponding to the symbols we want to reference.
-	Vec3 starmap1, starmap2;
-	FILE* starmap_file = fopen(starmap_path, "r");
-	if (!starmap_file)
+	constexpr s32 bits = GetSubdivisionBits<Factor>();
+	if constexpr (bits > 0)
 	{
-		printf("Unable to open file %s\n", starmap_path);
-		return 1;
+		constexpr s32 shift = bits * Level;
+		constexpr s64 mask = Factor - 1;
+		return subdivision_tables<Factor>.digits[(x >> shift) & mask][(y >> shift) & mask][(z >> shift) & mask];
 	}
-	bool success = FindStarmapVectors(starmap_file, id1, id2, &starmap1, &starmap2);
-	if (!success)
+	else
 	{
-		printf("Unable to find both starmap vectors for symbol IDs %d and %d in file %s\n", id1, id2, starmap_path);
-		return 1;
+		constexpr s64 power = GetSubdivisionPower<Factor, Level>();
+		return subdivision_tables<Factor>.digits[(x / power) % Factor][(y / power) % Factor][(z / power) % Factor];
 	}
+}
+
+// Fills in every level at once. The fold expression unrolls it, so every level is independent and uses constant shifts.
+template <s32 Factor, s32 Depth, s32... Levels>
+inline s32 GetSubdivisionDigits(s64 x, s64 y, s64 z, s32 out_indices[Depth], std::integer_sequence<s32, Levels...>)
+{
+	s32 invalid = 0;
+	((invalid |= (out_indices[Depth - 1 - Levels] = GetSubdivisionDigit<Factor, Levels>(x, y, z))), ...);
+	return invalid;
+}
+
+/*
+Same answer as SolveViaInterpolation(), but without any of the sanity checks. The barycentric coordinates get
+scaled and rounded down to integers once, same as before, and then each level's indices are just a few bits of those,
+so the whole thing is a few shifts, masks and table lookups. This is what SolveAddress() uses.
 
-	// Load the triangle lookup table.
-	IVec3 triangle_table[60] = {};
-	FILE* triangles_file = fopen(mapping_3d_path, "r");
-	if (!triangles_file)
+It's a template so that we can try other subdivision factors and depths without recompiling, see GetSubdivisionSolver().
+The real gate is SolveViaFixedPoint<SUBDIVISION_AMOUNT, SUBDIVISION_COUNT>().
+
+Returns false if the desired vector isn't on the face, or the indices don't form a triangle (which shouldn't happen).
+*/
+template <s32 Factor, s32 Depth>
+bool SolveViaFixedPoint(Vec3 desired, const Face& face, s32 out_indices[Depth])
+{
+	constexpr s64 divisions = GetSubdivisionPower<Factor, Depth>();
+	static_assert(divisions <= (1ll << 52), "Too many subdivisions to fit in the precision of a double.");
+	const double scale = (double)divisions;
+
+	// Rounding towards zero, same as SolveViaInterpolation(). That matters for tiny negative coordinates right on the
+	// edge of the face, which round up to 0 instead of down to -1. Anything further out than that is off the face.
+	Vec2 bary = CartesianToBarycentric(desired, face);
+	if (bary.u + bary.v > 1.0) return false;
+	s64 x = (s64)(bary.u * scale);
+	s64 y = (s64)(bary.v * scale);
+	s64 z = (s64)((1.0 - bary.u - bary.v) * scale);
+	TRACE(TRACE_DESCENT, TRACE_DETAIL, "Fixed point indices: (%lld, %lld, %lld) out of %lld", (long long)x, (long long)y, (long long)z, (long long)divisions);
+	if ((x | y | z) < 0) return false;
+	if (x == 0 || y == 0 || z == 0) CountMetric(METRIC_EDGE_HITS);
+
+	// The finest level is in the lowest digits, and goes last in the address.
+	bool solved = GetSubdivisionDigits<Factor, Depth>(x, y, z, out_indices, std::make_integer_sequence<s32, Depth>()) >= 0;
+	for (s32 i = 0; i < Depth; ++i) TRACE(TRACE_DESCENT, TRACE_STAGE, "Level %d -> %d", i + 1, out_indices[i]);
+	return solved;
+}
+
+/*
+Solvers for other subdivision factors and depths, instantiated ahead of time so the command line can pick one.
+Factors go from 2 to MAX_SOLVER_FACTOR, and depths from 1 to MAX_SOLVER_DEPTH.
+*/
+#define MAX_SOLVER_FACTOR 16
+#define MAX_SOLVER_DEPTH 8
+
+typedef bool (*SubdivisionSolver)(Vec3 desired, const Face& face, s32* out_indices);
+
+struct SubdivisionSolverTable
+{
+	SubdivisionSolver solvers[MAX_SOLVER_FACTOR + 1][MAX_SOLVER_DEPTH + 1]; // Indexed by factor and depth.
+};
+
+template <s32 Factor, s32... Depths>
+constexpr void AddSubdivisionSolvers(SubdivisionSolverTable& table, std::integer_sequence<s32, Depths...>)
+{
+	((table.solvers[Factor][Depths + 1] = SolveViaFixedPoint<Factor, Depths + 1>), ...);
+}
+
+template <s32... Factors>
+constexpr SubdivisionSolverTable GenerateSubdivisionSolvers(std::integer_sequence<s32, Factors...>)
+{
+	SubdivisionSolverTable table = {};
+	(AddSubdivisionSolvers<Factors + 2>(table, std::make_integer_sequence<s32, MAX_SOLVER_DEPTH>()), ...);
+	return table;
+}
+
+static constexpr SubdivisionSolverTable subdivision_solvers = GenerateSubdivisionSolvers(std::make_integer_sequence<s32, MAX_SOLVER_FACTOR - 1>());
+
+// Finds the solver for a subdivision factor and depth. Factors and depths outside the instantiated range return nullptr.
+SubdivisionSolver GetSubdivisionSolver(s32 factor, s32 depth)
+{
+	if (factor < 2 || factor > MAX_SOLVER_FACTOR || depth < 1 || depth > MAX_SOLVER_DEPTH) return nullptr;
+	return subdivision_solvers.solvers[factor][depth];
+}
+
+/*
+To find the first symbol quickly, we split the sphere into cells using a cube map, and store a short list of the faces
+that overlap each cell. A query then only has to raycast against the handful of faces in its cell, instead of all 60.
+The resolution is the number of cells along each edge of a cube face. With 16, most cells only list 2 or 3 faces.
+*/
+#define FACE_INDEX_RESOLUTION 16
+#define FACE_INDEX_CELL_COUNT (6 * FACE_INDEX_RESOLUTION * FACE_INDEX_RESOLUTION)
+#define FACE_INDEX_MAX_FACES 7
+
+// If a cell overlaps too many faces to fit in the list, we mark it with this count, and check every face instead.
+#define FACE_INDEX_OVERFLOW 0xFF
+
+struct FaceIndexCell
+{
+	u8 count;
+	u8 faces[FACE_INDEX_MAX_FACES]; // Face indices (symbol ID - 1), in increasing order.
+};
+
+// Largest symbol ID we allow in the 2D mapping.
+#define MAX_SYMBOL_ID 255
+
+/*
+Everything we need to solve addresses for one world seed, once the ball has been oriented.
+Loading and orienting the ball is the slow part, so build this once with LoadBall(),
+and then solve as many destination vectors against it as you like.
+*/
+struct Ball
+{
+	Starmap starmap; // Vectors from the starmapping research, see ParseStarmap().
+	IVec3 triangle_table[60]; // Icosahedron/dodecahedron vertex indices for each symbol, see ParseTriangleTable().
+	s32 mapping_table[SUBDIVIDED_TRIANGLE_COUNT]; // Symbol ID for each subdivided triangle index, see ParseMapping2D().
+	s16 triangle_from_symbol[MAX_SYMBOL_ID + 1]; // Inverse of mapping_table, or -1 for symbols that aren't in it.
+	Quat rotation; // Rotates the unoriented ball so that it lines up with the starmapping vectors.
+	Vec3 symbol_vectors[60]; // Oriented direction vector for each symbol, indexed by symbol ID - 1.
+	Face faces[60]; // Oriented face geometry for each symbol, indexed by symbol ID - 1.
+	FaceIndexCell face_index[FACE_INDEX_CELL_COUNT]; // Candidate faces for each cube map cell, see BuildFaceIndex().
+};
+
+// Rotates a vector by a quaternion, with the inverse passed in so it doesn't need to be recomputed.
+static Vec3 Rotate(Vec3 v, Quat rot, Quat rot_inv)
+{
+	return (rot * Quat(Vec4(v, 0.0)) * rot_inv).xyz;
+}
+
+// Angle in radians between two unit vectors. This uses atan2 instead of acos, since acos loses most of
+// its precision for tiny angles, and decoded addresses are usually within a fraction of a microradian.
+static double Angle(Vec3 a, Vec3 b)
+{
+	return ATan2(Length(Cross(a, b)), Dot(a, b));
+}
+
+// Angle in radians between a unit vector and the shortest great circle arc from a to b.
+static double AngleToArc(Vec3 p, Vec3 a, Vec3 b)
+{
+	// Project onto the plane of the great circle. If that lands between a and b, the closest point is on the arc,
+	// otherwise it's one of the ends.
+	Vec3 n = Normalize(Cross(a, b));
+	Vec3 q = p - n * Dot(p, n);
+	if (Dot(Cross(a, q), n) >= 0.0 && Dot(Cross(q, b), n) >= 0.0) return Angle(p, Normalize(q));
+	else return Min(Angle(p, a), Angle(p, b));
+}
+
+/*
+Checks that a direction can be looked up at all. Zero length vectors (which Normalize() leaves as zero), infinities and NaNs
+don't point anywhere, and would end up with a garbage cell from GetFaceIndexCell(). Vectors so big or small that their
+squared length overflows or underflows get turned away too, since Normalize() can't do anything sensible with them either.
+*/
+static bool IsValidDirection(Vec3 d)
+{
+	double length_squared = LengthSquared(d);
+	return length_squared > 0.0 && length_squared - length_squared == 0.0;
+}
+
+// Gets the cube map cell that a direction falls in. The direction does not need to be normalized, but must be valid, see IsValidDirection().
+static s32 GetFaceIndexCell(Vec3 d)
+{
+	// Pick the cube face from the largest axis, and project onto it to get coordinates in the range [-1, 1].
+	double ax = Abs(d.x);
+	double ay = Abs(d.y);
+	double az = Abs(d.z);
+	s32 cube_face;
+	Vec2 uv;
+	if (ax >= ay && ax >= az)
 	{
-		printf("Unable to open file %s\n", mapping_3d_path);
-		return 1;
+		cube_face = (d.x < 0.0) ? 1 : 0;
+		uv = Vec2(d.y, d.z) * (1.0 / ax);
 	}
-	success = ParseTriangleTable(triangles_file, triangle_table);
-	fclose(triangles_file);
-	if (!success)
+	else if (ay >= az)
 	{
-		printf("Unable to parse triangle lookup table in file %s\n", mapping_3d_path);
-		return 1;
+		cube_face = (d.y < 0.0) ? 3 : 2;
+		uv = Vec2(d.z, d.x) * (1.0 / ay);
+	}
+	else
+	{
+		cube_face = (d.z < 0.0) ? 5 : 4;
+		uv = Vec2(d.x, d.y) * (1.0 / az);
 	}
 
-	s32 mapping_table[64] = {};
-	FILE* mapping_file = fopen(mapping_2d_path, "r");
-	if (!mapping_file)
+	s32 i = (s32)Clamp((uv.u + 1.0) * (0.5 * FACE_INDEX_RESOLUTION), 0.0, FACE_INDEX_RESOLUTION - 1.0);
+	s32 j = (s32)Clamp((uv.v + 1.0) * (0.5 * FACE_INDEX_RESOLUTION), 0.0, FACE_INDEX_RESOLUTION - 1.0);
+	return (cube_face * FACE_INDEX_RESOLUTION + j) * FACE_INDEX_RESOLUTION + i;
+}
+
+// Gets the direction through a point on a cube map face, the inverse of the projection in GetFaceIndexCell().
+static Vec3 GetCubeDirection(s32 cube_face, Vec2 uv)
+{
+	double sign = (cube_face & 1) ? -1.0 : 1.0;
+	switch (cube_face / 2)
 	{
-		printf("Unable to open file %s\n", mapping_2d_path);
-		return 1;
+		case 0: return Normalize(Vec3(sign, uv.u, uv.v));
+		case 1: return Normalize(Vec3(uv.v, sign, uv.u));
+		default: return Normalize(Vec3(uv.u, uv.v, sign));
 	}
-	success = ParseMapping2D(mapping_file, mapping_table);
-	fclose(mapping_file);
-	if (!success)
+}
+
+/*
+Builds the cube map index of candidate faces. Each cell is covered by a circle on the sphere (the smallest one centered
+on the cell center which contains the corners), and any face whose spherical triangle touches that circle goes in the list.
+This is a little conservative, but it guarantees that a direction can only hit faces that are listed in its cell.
+*/
+static void BuildFaceIndex(const Face faces[60], FaceIndexCell face_index[FACE_INDEX_CELL_COUNT])
+{
+	// A little slack on the overlap test, so that rounding can't drop a face that just touches a cell.
+	const double tolerance = 0.000001;
+	const double cell_size = 2.0 / FACE_INDEX_RESOLUTION;
+
+	for (s32 cell = 0; cell < FACE_INDEX_CELL_COUNT; ++cell)
 	{
-		printf("Unable to parse 2d map lookup table in file %s\n", mapping_2d_path);
-		return 1;
+		s32 i = cell % FACE_INDEX_RESOLUTION;
+		s32 j = (cell / FACE_INDEX_RESOLUTION) % FACE_INDEX_RESOLUTION;
+		s32 cube_face = cell / (FACE_INDEX_RESOLUTION * FACE_INDEX_RESOLUTION);
+		Vec2 min_uv = Vec2(i * cell_size - 1.0, j * cell_size - 1.0);
+
+		Vec3 center = GetCubeDirection(cube_face, min_uv + Vec2(0.5 * cell_size));
+		double radius = 0.0;
+		radius = Max(radius, Angle(center, GetCubeDirection(cube_face, min_uv)));
+		radius = Max(radius, Angle(center, GetCubeDirection(cube_face, min_uv + Vec2(cell_size, 0.0))));
+		radius = Max(radius, Angle(center, GetCubeDirection(cube_face, min_uv + Vec2(0.0, cell_size))));
+		radius = Max(radius, Angle(center, GetCubeDirection(cube_face, min_uv + Vec2(cell_size))));
+		radius += tolerance;
+
+		FaceIndexCell result = {};
+		for (s32 f = 0; f < 60; ++f)
+		{
+			const Face& face = faces[f];
+			bool overlaps = RayTriangleIntersect(center, face, nullptr, nullptr, nullptr) ||
+				AngleToArc(center, face.v0, face.v1) <= radius ||
+				AngleToArc(center, face.v1, face.v2) <= radius ||
+				AngleToArc(center, face.v2, face.v0) <= radius;
+			if (!overlaps) continue;
+
+			if (result.count == FACE_INDEX_MAX_FACES)
+			{
+				result.count = FACE_INDEX_OVERFLOW;
+				break;
+			}
+			result.faces[result.count++] = (u8)f;
+		}
+		face_index[cell] = result;
 	}
+}
 
-	// Project all the vertices onto a unit sphere.
+// Loads the triangle lookup table from a file, see ParseTriangleTable(). Returns true if successful.
+bool LoadTriangleTable(const char* mapping_3d_path, IVec3 triangle_table[60])
+{
+	s32 row_count;
+	if (!LoadCsv(mapping_3d_path, ParseTriangleTable, NoCsvAllocation, triangle_table, &row_count, nullptr)) return false;
+	if (row_count != 60)
+	{
+		printf("Unable to parse triangle lookup table in file %s, expected 60 triangles but found %d\n", mapping_3d_path, row_count);
+		return false;
+	}
+	return true;
+}
+
+// Projects all the icosahedron and dodecahedron vertices onto a unit sphere. Only the first call does anything,
+// so that loading more than one ball doesn't keep nudging them around by rounding errors.
+static void NormalizeBallVertices()
+{
+	static bool normalized = false;
+	if (normalized) return;
 	for (s32 i = 0; i < ARRAYCOUNT(icosahedron); ++i) icosahedron[i] = Normalize(icosahedron[i]);
 	for (s32 i = 0; i < ARRAYCOUNT(dodecahedron); ++i) dodecahedron[i] = Normalize(dodecahedron[i]);
+	normalized = true;
+}
 
-	// Find the rotation we can apply to our ball to align the symbols with the known starmapping vectors.
+/*
+Finds the rotation we can apply to our ball to align the symbols with the known starmapping vectors.
+The first symbol lines up with its starmap vector exactly, and the second one only decides how the ball is rolled around it.
+NormalizeBallVertices() must have been called first.
+*/
+static Quat GetBallRotation(const IVec3 triangle_table[60], s32 id1, s32 id2, Vec3 starmap1, Vec3 starmap2)
+{
 	Vec3 forward = GetSymbolDirection(id1, triangle_table);
 	Vec3 right = Normalize(Cross(forward, GetSymbolDirection(id2, triangle_table)));
 	Vec3 up = Normalize(Cross(forward, right));
@@ -561,71 +1025,373 @@ s32 SolveRotation(s32 id1, s32 id2, Vec3 desired, const char* mapping_3d_path, c
 
 	Quat q1 = Quat(forward, right, up);
 	Quat q2 = Quat(starmap_forward, starmap_right, starmap_up);
-	Quat diff_rot = q2 * Invert(q1);
+	return q2 * Invert(q1);
+}
 
-	printf("\nSymbol ID,X,Y,Z\n");
-	Vec3 symbol_vectors[ARRAYCOUNT(triangle_table)] = {};
-	for (s32 i = 0; i < ARRAYCOUNT(triangle_table); ++i)
+/*
+Finds the orientation that lines up every vector in the starmap with its symbol as well as possible, rather than just
+two of them, see SolveAttitude(). Optionally returns the RMS distance between the starmap vectors and their symbols,
+which is about the same as the RMS angle in radians. NormalizeBallVertices() must have been called first.
+
+Returns true if successful, or false if the starmap doesn't have two different directions in it.
+*/
+static bool FitStarmapRotation(const Starmap& starmap, const IVec3 triangle_table[60], Quat* out_rotation, double* out_rms_error)
+{
+	AttitudeProfile profile = {};
+	for (s32 i = 0; i < starmap.count; ++i)
 	{
-		Vec3 v_start = GetSymbolDirection(i + 1, triangle_table);
-		Vec3 v = (diff_rot * Quat(Vec4(v_start, 0.0)) * Invert(diff_rot)).xyz;
-		printf("%d,%.15f,%.15f,%.15f\n", i + 1, v.x, v.y, v.z);
-		symbol_vectors[i] = v;
+		s32 id = starmap.ids[i];
+		AddAttitudeObservation(&profile, GetSymbolDirection(id, triangle_table), starmap.vectors[id - 1], 1.0);
 	}
 
-	// Scan back to the first starmap vector in the file, we will parse it again to check our results.
-	fseek(starmap_file, 0, SEEK_SET);
-	if (fscanf(starmap_file, "%*d,%*lf,%*lf,%*lf\n") == 0) fscanf(starmap_file, "%*[^\n]\n");
-	else fseek(starmap_file, 0, SEEK_SET);
+	double loss;
+	if (!SolveAttitude(profile, out_rotation, &loss))
+	{
+		printf("Need starmap vectors for at least two different symbols to find the orientation.\n");
+		return false;
+	}
+	if (out_rms_error) *out_rms_error = Sqrt(2.0 * loss / profile.weight_sum);
+	TRACE(TRACE_ORIENTATION, TRACE_STAGE, "Fit the rotation to %d starmap vectors, with an RMS error of %.15g", starmap.count, Sqrt(2.0 * loss / profile.weight_sum));
+	return true;
+}
 
-	printf("\nChecking how close we are to the rest of the starmap vectors...\n\n");
-	printf("Symbol ID,Similarity (ACos Angle),Computed X,Computed Y,Computed Z,Starmap X,Starmap Y,Starmap Z\n");
+/*
+Orients a ball that already has its starmap and mapping tables loaded, so that the faces for symbols id1 and id2 line up
+with their starmap vectors. If both IDs are 0, it's rotated to line up with every starmap vector as well as possible instead,
+see FitStarmapRotation(). Nothing gets read from files, so this is cheap to call again with other IDs.
 
-	s32 id;
-	Vec3 v;
-	while (fscanf(starmap_file, "%d,%lf,%lf,%lf\n", &id, &v.x, &v.y, &v.z) == 4)
+Returns true if successful, or false if the starmap doesn't have the vectors we need.
+*/
+bool OrientBall(s32 id1, s32 id2, Ball* ball)
+{
+	s64 start = StartMetricsTimer();
+	NormalizeBallVertices();
+	if (id1 == 0 && id2 == 0)
 	{
-		Vec3 computed = symbol_vectors[id - 1];
-		Vec3 starmap = v;
-		double angle = Dot(computed, starmap) / (Length(computed) * Length(starmap));
-		printf("%d,%.15f,%.15f,%.15f,%.15f,%.15f,%.15f,%.15f\n", id, angle, computed.x, computed.y, computed.z, starmap.x, starmap.y, starmap.z);
+		if (!FitStarmapRotation(ball->starmap, ball->triangle_table, &ball->rotation, nullptr)) return false;
 	}
-	fclose(starmap_file);
+	else
+	{
+		Vec3 starmap1, starmap2;
+		if (!GetStarmapVector(ball->starmap, id1, &starmap1) || !GetStarmapVector(ball->starmap, id2, &starmap2))
+		{
+			printf("Unable to find both starmap vectors for symbol IDs %d and %d\n", id1, id2);
+			return false;
+		}
+		ball->rotation = GetBallRotation(ball->triangle_table, id1, id2, starmap1, starmap2);
+	}
+	TRACE(TRACE_ORIENTATION, TRACE_STAGE, "Rotation: (%.15f, %.15f, %.15f, %.15f)", ball->rotation.x, ball->rotation.y, ball->rotation.z, ball->rotation.w);
 
-	// Find the first symbol by raycasting our desired vector agaainst every triangular face in the ball.
-	// Whichever face we hit is the first symbol in the combination!
-	printf("\nFinding the first symbol...");
-	s32 first_symbol = 0;
-	Vec3 v0, v1, v2;
-	for (s32 i = 1; i <= ARRAYCOUNT(triangle_table); ++i)
+	Quat rotation_inv = Invert(ball->rotation);
+	for (s32 i = 0; i < ARRAYCOUNT(ball->symbol_vectors); ++i)
+	{
+		ball->symbol_vectors[i] = Rotate(GetSymbolDirection(i + 1, ball->triangle_table), ball->rotation, rotation_inv);
+
+		Vec3 v0 = Rotate(icosahedron[ball->triangle_table[i].x], ball->rotation, rotation_inv);
+		Vec3 v1 = Rotate(dodecahedron[ball->triangle_table[i].y], ball->rotation, rotation_inv);
+		Vec3 v2 = Rotate(dodecahedron[ball->triangle_table[i].z], ball->rotation, rotation_inv);
+		ball->faces[i] = BuildFace(v0, v1, v2);
+		TRACE(TRACE_ORIENTATION, TRACE_DETAIL, "Symbol ID %d: (%.15f, %.15f, %.15f)", i + 1, ball->symbol_vectors[i].x, ball->symbol_vectors[i].y, ball->symbol_vectors[i].z);
+	}
+	BuildFaceIndex(ball->faces, ball->face_index);
+	RecordLatency(METRIC_ORIENTATION, start);
+	return true;
+}
+
+/*
+Everything LoadBall() builds only depends on the three mapping files and the two symbol IDs, so the compile-seed mode
+writes the finished Ball into a binary "seed pack", which LoadBall() can read instead of the CSV files. The pack is just a
+header followed by the raw bytes of the Ball, so loading one is a memory map and a checksum, with nothing to parse or solve.
+
+Since the Ball is stored exactly how it's laid out in memory, a pack only works with a build that has the same layout.
+The header records the version and the size of the Ball, and packs that don't match are rejected rather than misread.
+Bump the version whenever the meaning of anything in Ball changes without changing its size.
+*/
+#define SEED_PACK_MAGIC "VFSEEDPK"
+#define SEED_PACK_VERSION 1
+
+struct alignas(64) SeedPackHeader
+{
+	char magic[8];
+	u32 version;
+	u32 header_size;
+	u64 ball_size;
+	u64 checksum; // FNV-1a hash of the Ball's bytes.
+	s32 id1; // Symbol IDs the ball was oriented with.
+	s32 id2;
+};
+
+// An open seed pack. The ball points straight into the mapped file, so copy it out before closing the pack.
+struct SeedPack
+{
+	const char* data;
+	s64 size;
+	const Ball* ball;
+	s32 id1;
+	s32 id2;
+};
+
+// 64 bit FNV-1a, which is plenty to catch a truncated or corrupted pack.
+static u64 HashBytes(const void* data, s64 size)
+{
+	const u8* bytes = (const u8*)data;
+	u64 hash = 0xcbf29ce484222325ull;
+	for (s64 i = 0; i < size; ++i) hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+	return hash;
+}
+
+// Whether a file starts like a seed pack. Doesn't print anything if it can't be read.
+static bool IsSeedPack(const char* path)
+{
+	FILE* f = fopen(path, "rb");
+	if (!f) return false;
+	char magic[8] = {};
+	bool is_pack = fread(magic, 1, sizeof(magic), f) == sizeof(magic) && memcmp(magic, SEED_PACK_MAGIC, sizeof(magic)) == 0;
+	fclose(f);
+	return is_pack;
+}
+
+/*
+Writes an oriented ball to a seed pack, see OpenSeedPack(). id1 and id2 are only recorded so the pack can say how it was made.
+Returns true if successful.
+*/
+bool WriteSeedPack(const Ball& ball, s32 id1, s32 id2, const char* pack_path)
+{
+	SeedPackHeader header = {};
+	memcpy(header.magic, SEED_PACK_MAGIC, sizeof(header.magic));
+	header.version = SEED_PACK_VERSION;
+	header.header_size = sizeof(SeedPackHeader);
+	header.ball_size = sizeof(Ball);
+	header.checksum = HashBytes(&ball, sizeof(Ball));
+	header.id1 = id1;
+	header.id2 = id2;
+
+	FILE* f = fopen(pack_path, "wb");
+	if (!f)
+	{
+		printf("Unable to open file %s for writing\n", pack_path);
+		return false;
+	}
+	bool written = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(&ball, sizeof(Ball), 1, f) == 1;
+	if (fclose(f) != 0) written = false;
+	if (!written) printf("Unable to write seed pack %s\n", pack_path);
+	return written;
+}
+
+/*
+Maps a seed pack into memory, and checks that it's one this build can use. The ball can be used straight from the pack,
+without copying it, until the pack is closed with CloseSeedPack().
+
+Returns true if successful, or false if the file can't be read, or isn't a valid pack for this build.
+*/
+bool OpenSeedPack(const char* pack_path, SeedPack* out)
+{
+	*out = {};
+	if (!MapFile(pack_path, &out->data, &out->size)) return false;
+
+	const char* error = nullptr;
+	SeedPackHeader header = {};
+	if (out->size < (s64)sizeof(header)) error = "is too small to be a seed pack";
+	else
 	{
-		v0 = icosahedron[triangle_table[i - 1].x];
-		v1 = dodecahedron[triangle_table[i - 1].y];
-		v2 = dodecahedron[triangle_table[i - 1].z];
+		memcpy(&header, out->data, sizeof(header));
+		if (memcmp(header.magic, SEED_PACK_MAGIC, sizeof(header.magic)) != 0) error = "isn't a seed pack";
+		else if (header.version != SEED_PACK_VERSION || header.header_size != sizeof(SeedPackHeader) || header.ball_size != sizeof(Ball)) error = "was compiled by a different version, compile it again";
+		else if (out->size != (s64)(sizeof(SeedPackHeader) + sizeof(Ball))) error = "is the wrong size, it might be truncated";
+		else if (HashBytes(out->data + sizeof(SeedPackHeader), sizeof(Ball)) != header.checksum) error = "is corrupted, the checksum doesn't match";
+	}
+	if (error)
+	{
+		printf("Seed pack %s %s\n", pack_path, error);
+		UnmapFile(out->data, out->size);
+		*out = {};
+		return false;
+	}
+
+	// The header is a multiple of 64 bytes, and the mapping is page aligned, so the ball is aligned too.
+	out->ball = (const Ball*)(out->data + sizeof(SeedPackHeader));
+	out->id1 = header.id1;
+	out->id2 = header.id2;
+	return true;
+}
 
-		Quat diff_rot_inv = Invert(diff_rot);
-		v0 = (diff_rot * Quat(Vec4(v0, 0.0)) * diff_rot_inv).xyz;
-		v1 = (diff_rot * Quat(Vec4(v1, 0.0)) * diff_rot_inv).xyz;
-		v2 = (diff_rot * Quat(Vec4(v2, 0.0)) * diff_rot_inv).xyz;
+void CloseSeedPack(SeedPack* pack)
+{
+	UnmapFile(pack->data, pack->size);
+	*pack = {};
+}
+
+/*
+Loads the three mapping files, and solves the orientation of our ball in space given two known vectors from starmapping research.
+The ball is rotated so that the faces for symbols id1 and id2 line up with their starmap vectors, see OrientBall().
 
+If mapping_3d_path is a seed pack instead of a triangles file, the ball is just copied out of the pack, and the other paths
+are ignored, since the pack already has the ball oriented the way it was compiled. The IDs still have to be the ones it was
+compiled with though, since a pack for different IDs would give different answers without anyone noticing.
+
+Returns true if successful, or false if any of the files could not be read or parsed.
+*/
+bool LoadBall(s32 id1, s32 id2, const char* mapping_3d_path, const char* starmap_path, const char* mapping_2d_path, Ball* ball)
+{
+	if (IsSeedPack(mapping_3d_path))
+	{
+		SeedPack pack;
+		if (!OpenSeedPack(mapping_3d_path, &pack)) return false;
+		if (pack.id1 != id1 || pack.id2 != id2)
+		{
+			printf("Seed pack %s was compiled using symbol IDs %d and %d, not %d and %d\n", mapping_3d_path, pack.id1, pack.id2, id1, id2);
+			CloseSeedPack(&pack);
+			return false;
+		}
+		TRACE(TRACE_PARSING, TRACE_STAGE, "Loaded the ball from seed pack %s, compiled using symbol IDs %d and %d", mapping_3d_path, pack.id1, pack.id2);
+		*ball = *pack.ball;
+		CloseSeedPack(&pack);
+		return true;
+	}
+
+	// Load the starmap and the triangle lookup table.
+	if (!LoadStarmap(starmap_path, &ball->starmap)) return false;
+	if (!LoadTriangleTable(mapping_3d_path, ball->triangle_table)) return false;
+
+	s32 mapping_count;
+	if (!LoadCsv(mapping_2d_path, ParseMapping2D, NoCsvAllocation, ball->mapping_table, &mapping_count, nullptr)) return false;
+	if (mapping_count != SUBDIVIDED_TRIANGLE_COUNT)
+	{
+		printf("Unable to parse 2d map lookup table in file %s, expected %d triangles but found %d\n", mapping_2d_path, SUBDIVIDED_TRIANGLE_COUNT, mapping_count);
+		return false;
+	}
+
+	// Build the inverse mapping, so that we can go from an address back to a triangle.
+	for (s32 i = 0; i < ARRAYCOUNT(ball->triangle_from_symbol); ++i) ball->triangle_from_symbol[i] = -1;
+	for (s32 i = 0; i < SUBDIVIDED_TRIANGLE_COUNT; ++i)
+	{
+		s32 id = ball->mapping_table[i];
+		if (id < 1 || id > MAX_SYMBOL_ID || ball->triangle_from_symbol[id] >= 0)
+		{
+			printf("Symbol ID %d at index %d in file %s is either invalid or used twice\n", id, i, mapping_2d_path);
+			return false;
+		}
+		ball->triangle_from_symbol[id] = (s16)i;
+	}
+
+	return OrientBall(id1, id2, ball);
+}
+
+/*
+Finds the first symbol by raycasting our desired vector against the triangular faces in the oriented ball.
+Whichever face we hit is the first symbol in the combination! Returns the symbol ID, or 0 if we didn't hit anything.
+The face for the symbol is ball.faces[symbol_id - 1], which we subdivide for the remaining symbols.
+
+We only raycast against the candidate faces from the cube map index, unless the cell has too many faces in it.
+The candidates are in the same order as the faces, so if we're right on an edge, we still pick the same face as checking them all.
+*/
+s32 FindFirstSymbol(const Ball& ball, Vec3 desired)
+{
+	s64 start = StartMetricsTimer();
+	if (!IsValidDirection(desired))
+	{
+		TRACE(TRACE_FIRST_SYMBOL, TRACE_STAGE, "(%f, %f, %f) isn't a valid direction", desired.x, desired.y, desired.z);
+		RecordLatency(METRIC_FIRST_FACE, start);
+		return 0;
+	}
+	Vec3 d = Normalize(desired);
+	const FaceIndexCell& cell = ball.face_index[GetFaceIndexCell(d)];
+	bool check_all = (cell.count == FACE_INDEX_OVERFLOW);
+	s32 count = check_all ? (s32)ARRAYCOUNT(ball.faces) : cell.count;
+	for (s32 c = 0; c < count; ++c)
+	{
+		s32 i = (check_all ? c : cell.faces[c]) + 1;
+		const Face& face = ball.faces[i - 1];
 		Vec3 intersection;
 		double u, v;
-		bool does_intersect = RayTriangleIntersect(Normalize(desired), v0, v1, v2, &intersection, &u, &v);
+		bool does_intersect = RayTriangleIntersect(d, face, &intersection, &u, &v);
 
 		if (does_intersect)
 		{
-			printf("Intersection found with face for symbol ID %d:\nVertex 1: (%f, %f, %f)\nVertex 2: (%f, %f, %f)\nVertex 3: (%f, %f, %f)\n", i, v0.x, v0.y, v0.z, v1.x, v1.y, v1.z, v2.x, v2.y, v2.z);
-			printf("Intersection Point: (%f, %f, %f), U=%f, V=%f\n", intersection.x, intersection.y, intersection.z, u, v);
-			if (first_symbol > 0)
-			{
-				printf("The destination vector intersects more than one symbol face, that isn't supposed to happen!\n");
-				return 1;
-			}
-			first_symbol = i;
-			break;
+			TRACE(TRACE_FIRST_SYMBOL, TRACE_STAGE, "Intersection found with face for symbol ID %d, after checking %d of %d faces", i, c + 1, count);
+			TRACE(TRACE_FIRST_SYMBOL, TRACE_DETAIL, "Vertex 1: (%f, %f, %f)", face.v0.x, face.v0.y, face.v0.z);
+			TRACE(TRACE_FIRST_SYMBOL, TRACE_DETAIL, "Vertex 2: (%f, %f, %f)", face.v1.x, face.v1.y, face.v1.z);
+			TRACE(TRACE_FIRST_SYMBOL, TRACE_DETAIL, "Vertex 3: (%f, %f, %f)", face.v2.x, face.v2.y, face.v2.z);
+			TRACE(TRACE_FIRST_SYMBOL, TRACE_DETAIL, "Intersection Point: (%f, %f, %f), U=%f, V=%f", intersection.x, intersection.y, intersection.z, u, v);
+			RecordLatency(METRIC_FIRST_FACE, start);
+			return i;
 		}
 	}
+	TRACE(TRACE_FIRST_SYMBOL, TRACE_STAGE, "No face intersects (%.15f, %.15f, %.15f), after checking %d faces", d.x, d.y, d.z, count);
+	RecordLatency(METRIC_FIRST_FACE, start);
+	return 0;
+}
+
+/*
+Solves the full 8 symbol address for a desired vector, using an already oriented ball.
+This is the quiet version of what SolveRotation() does, using the interpolation method for the last 7 symbols
+(the fixed point version of it, see SolveViaFixedPoint()).
+
+Returns true if successful. If the vector couldn't be solved, the address is filled with zeroes and we return false.
+*/
+bool SolveAddress(const Ball& ball, Vec3 desired, s32 out_address[ADDRESS_LENGTH])
+{
+	s32 indices[SUBDIVISION_COUNT];
+	CountMetric(METRIC_QUERIES);
+	s32 first_symbol = FindFirstSymbol(ball, desired);
+	s64 start = StartMetricsTimer();
+	bool solved = first_symbol && SolveViaFixedPoint<SUBDIVISION_AMOUNT, SUBDIVISION_COUNT>(desired, ball.faces[first_symbol - 1], indices);
+	if (first_symbol) RecordLatency(METRIC_DESCENT, start);
+	if (!solved)
+	{
+		CountMetric(METRIC_UNSOLVED);
+		for (s32 i = 0; i < ADDRESS_LENGTH; ++i) out_address[i] = 0;
+		return false;
+	}
+
+	out_address[0] = first_symbol;
+	for (s32 i = 0; i < SUBDIVISION_COUNT; ++i) out_address[i + 1] = ball.mapping_table[indices[i]];
+	return true;
+}
+
+/*
+Solves the orientation of our ball in space given two known vectors from starmapping research.
+Uses the resulting ball to compute the first symbol, and then uses the triangular face for that
+symbol to compute the remaining 7, with two methods. You will need to build three mapping files yourself:
+
+One is way to map each symbol to one vertex of an icosahedron, and two vertices of a dodecahedron.
+Another maps each symbol to a triangle subdivided into 64 smaller ones, using the indexing scheme from ParseMapping2D().
+The remaining file is just a list of vectors from starmapping research, and their corresponding symbol IDs.
+
+I created the first two mappings using various paint programs, with Blender and UE4 to visualize and create the 3D map.
+*/
+s32 SolveRotation(s32 id1, s32 id2, Vec3 desired, const char* mapping_3d_path, const char* starmap_path, const char* mapping_2d_path)
+{
+	Ball ball = {};
+	if (!LoadBall(id1, id2, mapping_3d_path, starmap_path, mapping_2d_path, &ball)) return 1;
+
+	// Every step traces what it did, which only gets recorded in debug builds, see Trace.cpp. We print each step's traces
+	// right after it, so they show up in the right place.
+	DumpTrace(stdout);
 
+	printf("\nSymbol ID,X,Y,Z\n");
+	for (s32 i = 0; i < ARRAYCOUNT(ball.symbol_vectors); ++i)
+	{
+		Vec3 v = ball.symbol_vectors[i];
+		printf("%d,%.15f,%.15f,%.15f\n", i + 1, v.x, v.y, v.z);
+	}
+
+	// Check our results against the rest of the starmap vectors.
+	printf("\nChecking how close we are to the rest of the starmap vectors...\n\n");
+	printf("Symbol ID,Similarity (ACos Angle),Computed X,Computed Y,Computed Z,Starmap X,Starmap Y,Starmap Z\n");
+	for (s32 i = 0; i < ball.starmap.count; ++i)
+	{
+		s32 id = ball.starmap.ids[i];
+		Vec3 computed = ball.symbol_vectors[id - 1];
+		Vec3 starmap = ball.starmap.vectors[id - 1];
+		double angle = Dot(computed, starmap) / (Length(computed) * Length(starmap));
+		printf("%d,%.15f,%.15f,%.15f,%.15f,%.15f,%.15f,%.15f\n", id, angle, computed.x, computed.y, computed.z, starmap.x, starmap.y, starmap.z);
+	}
+
+	// Find the first symbol by raycasting our desired vector agaainst every triangular face in the ball.
+	printf("\nFinding the first symbol...\n");
+	s32 first_symbol = FindFirstSymbol(ball, desired);
+	DumpTrace(stdout);
 	if (!first_symbol)
 	{
 		printf("The destination vector doesn't intersect any symbol faces.\n");
@@ -636,11 +1402,16 @@ s32 SolveRotation(s32 id1, s32 id2, Vec3 desired, const char* mapping_3d_path, c
 	s32 output_raycasting[SUBDIVISION_COUNT] = {};
 	s32 output_interpolation[SUBDIVISION_COUNT] = {};
 	printf("\nAttempting to solve using raycasting and subdividing...\n");
-	if (!SolveViaRaycast(desired, v0, v1, v2, triangle_table, output_raycasting)) return 1;
+	const Face& face = ball.faces[first_symbol - 1];
+	bool solved = SolveViaRaycast(desired, face, output_raycasting);
+	DumpTrace(stdout);
+	if (!solved) return 1;
 	printf("\nAttempting to solve by interpolating barycentric coordinates...\n");
-	if (!SolveViaInterpolation(desired, v0, v1, v2, output_interpolation)) return 1;
-	for (s32 i = 0; i < ARRAYCOUNT(output_raycasting); ++i) output_raycasting[i] = mapping_table[output_raycasting[i]];
-	for (s32 i = 0; i < ARRAYCOUNT(output_interpolation); ++i) output_interpolation[i] = mapping_table[output_interpolation[i]];
+	solved = SolveViaInterpolation(desired, face, output_interpolation);
+	DumpTrace(stdout);
+	if (!solved) return 1;
+	for (s32 i = 0; i < ARRAYCOUNT(output_raycasting); ++i) output_raycasting[i] = ball.mapping_table[output_raycasting[i]];
+	for (s32 i = 0; i < ARRAYCOUNT(output_interpolation); ++i) output_interpolation[i] = ball.mapping_table[output_interpolation[i]];
 
 	printf("\nSolution found by raycasting and subdividing: (%d, ", first_symbol);
 	for (s32 i = 0; i < ARRAYCOUNT(output_raycasting) - 1; ++i) printf("%d, ", output_raycasting[i]);
@@ -651,4 +1422,31 @@ s32 SolveRotation(s32 id1, s32 id2, Vec3 desired, const char* mapping_3d_path, c
 	printf("%d)\n", output_interpolation[ARRAYCOUNT(output_interpolation) - 1]);
 	
 	return 0;
-}
\ No newline at end of file
+}
+
+/*
+Loads and orients the ball the same way as every other mode, and writes it to a seed pack, see WriteSeedPack().
+Any mode can then be given the pack instead of the triangles file, which skips all the parsing and solving.
+
+Returns 0 if successful, or 1 if an error occured when reading/parsing the files, or writing the pack.
+*/
+s32 RunCompileSeed(s32 id1, s32 id2, const char* pack_path, const char* mapping_3d_path, const char* starmap_path, const char* mapping_2d_path)
+{
+	Ball ball = {};
+	if (!LoadBall(id1, id2, mapping_3d_path, starmap_path, mapping_2d_path, &ball)) return 1;
+	if (!WriteSeedPack(ball, id1, id2, pack_path)) return 1;
+
+	// Read it straight back, so a bad pack gets caught now rather than by whatever uses it.
+	SeedPack pack;
+	if (!OpenSeedPack(pack_path, &pack)) return 1;
+	bool same = memcmp(pack.ball, &ball, sizeof(Ball)) == 0;
+	CloseSeedPack(&pack);
+	if (!same)
+	{
+		printf("Seed pack %s doesn't match the ball it was compiled from\n", pack_path);
+		return 1;
+	}
+
+	printf("Compiled seed pack %s (%lld bytes) using symbol IDs %d and %d, from triangles file %s, starmap file %s, 2d mapping file %s\n", pack_path, (long long)(sizeof(SeedPackHeader) + sizeof(Ball)), id1, id2, mapping_3d_path, starmap_path, mapping_2d_path);
+	return 0;
+}
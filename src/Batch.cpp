@@ -0,0 +1,249 @@
+#include "Core.h"
+
+#include <atomic>
+
+/*
+Batch mode, for when we want addresses for a whole list of destinations instead of just one.
+Loading and orienting the ball only happens once, and then every vector goes through the same
+first symbol lookup and subdivision steps as SolveRotation(), just without all the printing.
+*/
+
+// Number of vectors each thread solves at a time in SolveAddresses().
+#define SOLVE_CHUNK_SIZE 256
+
+// Everything the threads need for SolveAddresses(). The ball is only read, and each chunk writes its own addresses.
+struct SolveAddressesJob
+{
+	const Ball* ball;
+	Vec3Batch desired;
+	s32 (*out_addresses)[ADDRESS_LENGTH];
+	s32 beam_width;
+	const SlotConstraints* constraints;
+	std::atomic<s32> solved_count;
+};
+
+static void SolveAddressesChunk(void* data, s32 begin, s32 end)
+{
+	SolveAddressesJob* job = (SolveAddressesJob*)data;
+
+	// Normalize this chunk all in one go. The rest of the solve is mostly branches and table lookups
+	// that are different for every vector, so that part still goes one vector at a time.
+	Vec3Batch desired = job->desired.Slice(begin, end - begin);
+	desired.Assign(Normalize(desired));
+
+	s32 solved_count = 0;
+	for (s32 i = 0; i < desired.count; ++i)
+	{
+		bool solved;
+		if (job->constraints) solved = SolveConstrainedAddress(*job->ball, desired[i], *job->constraints, job->out_addresses[begin + i], nullptr);
+		else if (job->beam_width > 0) solved = SearchAddress(*job->ball, desired[i], job->beam_width, job->out_addresses[begin + i], nullptr);
+		else solved = SolveAddress(*job->ball, desired[i], job->out_addresses[begin + i]);
+		if (solved) ++solved_count;
+	}
+	job->solved_count += solved_count;
+}
+
+/*
+Solves addresses for a batch of desired vectors, using an already oriented ball.
+Vectors that can't be solved get an address of all zeroes. The vectors are normalized in place.
+With a beam width of 0 we use SolveAddress(), otherwise SearchAddress() with that beam width.
+If constraints are given, we use SolveConstrainedAddress() instead, and the beam width is ignored.
+
+If a thread pool is given, the batch is split into chunks and solved on all of its threads.
+Each vector only ever writes its own address, so the output is the same for any number of threads.
+
+Returns the number of vectors that were solved successfully.
+*/
+s32 SolveAddresses(const Ball& ball, Vec3Batch desired, s32 (*out_addresses)[ADDRESS_LENGTH], s32 beam_width, const SlotConstraints* constraints, ThreadPool* pool)
+{
+	SolveAddressesJob job;
+	job.ball = &ball;
+	job.desired = desired;
+	job.out_addresses = out_addresses;
+	job.beam_width = beam_width;
+	job.constraints = constraints;
+	job.solved_count = 0;
+
+	if (pool) RunParallel(pool, desired.count, SOLVE_CHUNK_SIZE, SolveAddressesChunk, &job);
+	else SolveAddressesChunk(&job, 0, desired.count);
+	return job.solved_count;
+}
+
+/*
+Parses a CSV file of desired vectors, one per row, formatted as X,Y,Z.
+The first row can optionally be a header, which will be skipped.
+*/
+static bool ParseQueries(CsvReader* reader, void* data, s32 row)
+{
+	Vec3Batch* queries = (Vec3Batch*)data;
+	Vec3 v;
+	if (!CsvReadVec3(reader, &v)) return false;
+	queries->Set(row, v);
+	return true;
+}
+
+static void AllocateQueries(void* data, s32 row_count)
+{
+	*(Vec3Batch*)data = Vec3Batch::Allocate(row_count);
+}
+
+/*
+Loads every desired vector in a CSV file, see ParseQueries(). Big files are parsed on every thread in the pool.
+Returns true if successful, in which case the batch must be freed by the caller.
+*/
+static bool LoadQueries(const char* queries_path, Vec3Batch* out_queries, ThreadPool* pool)
+{
+	*out_queries = {};
+	s32 count;
+	if (!LoadCsv(queries_path, ParseQueries, AllocateQueries, out_queries, &count, pool))
+	{
+		out_queries->Free();
+		return false;
+	}
+	return true;
+}
+
+/*
+Solves an address for every desired vector in a CSV file, and prints them all as CSV rows.
+See ParseQueries() for the input format, and LoadBall() for the other arguments.
+The vectors are solved on thread_count threads, or one per core if thread_count is 0.
+If beam_width is more than 0, each address is the one that decodes closest to its vector, see SearchAddress().
+If constraints_path isn't null, each address is the closest one that the gate will accept, see LoadSlotConstraints().
+
+Returns 0 if successful, or 1 if an error occured when reading/parsing the files.
+Vectors which couldn't be solved are printed with an address of all zeroes, but are not considered an error.
+*/
+s32 RunBatch(s32 id1, s32 id2, const char* queries_path, const char* mapping_3d_path, const char* starmap_path, const char* mapping_2d_path, s32 thread_count, s32 beam_width, const char* constraints_path)
+{
+	Ball ball = {};
+	if (!LoadBall(id1, id2, mapping_3d_path, starmap_path, mapping_2d_path, &ball)) return 1;
+	SlotConstraints constraints = {};
+	if (constraints_path && !LoadSlotConstraints(ball, constraints_path, &constraints)) return 1;
+
+	ThreadPool pool;
+	StartThreadPool(&pool, thread_count);
+	Vec3Batch queries;
+	if (!LoadQueries(queries_path, &queries, &pool))
+	{
+		StopThreadPool(&pool);
+		return 1;
+	}
+
+	s32 count = queries.count;
+	s32 (*addresses)[ADDRESS_LENGTH] = (s32 (*)[ADDRESS_LENGTH])malloc(count * sizeof(*addresses));
+	SolveAddresses(ball, queries, addresses, beam_width, constraints_path ? &constraints : nullptr, &pool);
+	StopThreadPool(&pool);
+
+	OutputWriter output;
+	StartOutput(&output, stdout, output_format);
+	AddOutputColumn(&output, "Index");
+	for (s32 i = 0; i < ADDRESS_LENGTH; ++i) AddOutputColumn(&output, "Symbol %d", i + 1);
+	WriteOutputHeader(&output);
+	for (s32 i = 0; i < count; ++i)
+	{
+		WriteOutputInt(&output, i);
+		for (s32 j = 0; j < ADDRESS_LENGTH; ++j) WriteOutputInt(&output, addresses[i][j]);
+		EndOutputRow(&output);
+	}
+	FinishOutput(&output);
+
+	free(addresses);
+	queries.Free();
+	return 0;
+}
+
+// Longest address RunSubdivisionBatch() can print, the first symbol followed by one index per level.
+#define MAX_SOLVER_ADDRESS_LENGTH (MAX_SOLVER_DEPTH + 1)
+
+struct SubdivisionBatchJob
+{
+	const Ball* ball;
+	Vec3Batch desired;
+	SubdivisionSolver solver;
+	s32 (*out_addresses)[MAX_SOLVER_ADDRESS_LENGTH];
+};
+
+static void SubdivisionBatchChunk(void* data, s32 begin, s32 end)
+{
+	SubdivisionBatchJob* job = (SubdivisionBatchJob*)data;
+	Vec3Batch desired = job->desired.Slice(begin, end - begin);
+	desired.Assign(Normalize(desired));
+
+	for (s32 i = 0; i < desired.count; ++i)
+	{
+		s32* address = job->out_addresses[begin + i];
+		CountMetric(METRIC_QUERIES);
+		address[0] = FindFirstSymbol(*job->ball, desired[i]);
+		s64 start = StartMetricsTimer();
+		bool solved = address[0] && job->solver(desired[i], job->ball->faces[address[0] - 1], address + 1);
+		if (address[0]) RecordLatency(METRIC_DESCENT, start);
+		if (!solved)
+		{
+			CountMetric(METRIC_UNSOLVED);
+			for (s32 j = 0; j < MAX_SOLVER_ADDRESS_LENGTH; ++j) address[j] = 0;
+		}
+	}
+}
+
+/*
+Same as RunBatch(), but with some other subdivision factor and depth instead of the real gate's, to see how other
+configurations would behave. See GetSubdivisionSolver() for which ones are available.
+
+Only the real gate's factor has a 2D mapping, so for anything else, each level is printed as the raw subdivided
+triangle index (numbered the same way as ParseMapping2D()) rather than a symbol ID.
+
+Returns 0 if successful, or 1 if an error occured when reading/parsing the files.
+*/
+s32 RunSubdivisionBatch(s32 id1, s32 id2, const char* queries_path, s32 factor, s32 depth, const char* mapping_3d_path, const char* starmap_path, const char* mapping_2d_path, s32 thread_count)
+{
+	SubdivisionSolver solver = GetSubdivisionSolver(factor, depth);
+	if (!solver)
+	{
+		printf("No solver for a subdivision factor of %d and depth of %d, the factor needs to be between 2 and %d, and the depth between 1 and %d.\n", factor, depth, MAX_SOLVER_FACTOR, MAX_SOLVER_DEPTH);
+		return 1;
+	}
+
+	Ball ball = {};
+	if (!LoadBall(id1, id2, mapping_3d_path, starmap_path, mapping_2d_path, &ball)) return 1;
+
+	ThreadPool pool;
+	StartThreadPool(&pool, thread_count);
+	Vec3Batch queries;
+	if (!LoadQueries(queries_path, &queries, &pool))
+	{
+		StopThreadPool(&pool);
+		return 1;
+	}
+
+	s32 count = queries.count;
+	s32 (*addresses)[MAX_SOLVER_ADDRESS_LENGTH] = (s32 (*)[MAX_SOLVER_ADDRESS_LENGTH])malloc(count * sizeof(*addresses));
+
+	SubdivisionBatchJob job;
+	job.ball = &ball;
+	job.desired = queries;
+	job.solver = solver;
+	job.out_addresses = addresses;
+	RunParallel(&pool, count, SOLVE_CHUNK_SIZE, SubdivisionBatchChunk, &job);
+	StopThreadPool(&pool);
+
+	bool use_symbols = (factor == SUBDIVISION_AMOUNT);
+	OutputWriter output;
+	StartOutput(&output, stdout, output_format);
+	AddOutputColumn(&output, "Index");
+	AddOutputColumn(&output, "Symbol 1");
+	for (s32 i = 0; i < depth; ++i) AddOutputColumn(&output, use_symbols ? "Symbol %d" : "Triangle %d", i + 2);
+	WriteOutputHeader(&output);
+	for (s32 i = 0; i < count; ++i)
+	{
+		const s32* address = addresses[i];
+		WriteOutputInt(&output, i);
+		WriteOutputInt(&output, address[0]);
+		for (s32 j = 1; j <= depth; ++j) WriteOutputInt(&output, (use_symbols && address[0]) ? ball.mapping_table[address[j]] : address[j]);
+		EndOutputRow(&output);
+	}
+	FinishOutput(&output);
+
+	free(addresses);
+	queries.Free();
+	return 0;
+}
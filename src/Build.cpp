@@ -3,6 +3,19 @@
 // This tends to prevent some linker slowness for simple builds, and makes it easy to add source files.
 // Just include the files you want to get built here!
 
+#include "ThreadPool.cpp"
+#include "Trace.cpp"
+#include "Metrics.cpp"
+#include "Csv.cpp"
+#include "Output.cpp"
 #include "Interburbul.cpp"
+#include "Attitude.cpp"
 #include "Ball.cpp"
+#include "Decode.cpp"
+#include "Search.cpp"
+#include "Constraints.cpp"
+#include "Batch.cpp"
+#include "Deep.cpp"
+#include "ReferencePairs.cpp"
+#include "Serve.cpp"
 #include "Main.cpp"
\ No newline at end of file
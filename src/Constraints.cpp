@@ -0,0 +1,250 @@
+#include "Core.h"
+
+/*
+Some symbols can't be used in certain slots on the stargate. SolveAddress() and SearchAddress() don't know about that,
+so they can give us an address that the gate won't accept. This loads a table of which symbols are allowed in which slot,
+and searches for the closest address that only uses allowed symbols.
+
+The table is a CSV file with one row per symbol, formatted as "Symbol ID,Slot 1,Slot 2,...,Slot 8", where each slot
+is 1 if the symbol is allowed there, or 0 if it isn't. Symbols that aren't in the file are allowed in every slot.
+*/
+
+// Symbol IDs in the constraints file have to fit in a 64 bit mask.
+#define MAX_CONSTRAINED_SYMBOL_ID 64
+
+struct SlotConstraints
+{
+	u64 allowed_symbols[ADDRESS_LENGTH]; // Bit (symbol ID - 1) is set if the symbol is allowed in that slot.
+	u64 allowed_triangles[SUBDIVISION_COUNT]; // Same thing for the last 7 slots, but by subdivided triangle index.
+};
+
+/*
+Parses one row of the constraints file described above into allowed_symbols. The first row can optionally be a header, which will be skipped.
+*/
+static bool ParseSlotConstraints(CsvReader* reader, void* data, s32 row)
+{
+	SlotConstraints* out = (SlotConstraints*)data;
+	const char* id_start = reader->cursor;
+	s32 id;
+	if (!CsvReadField(reader, &id)) return false;
+	if (id < 1 || id > MAX_CONSTRAINED_SYMBOL_ID) return CsvError(reader, id_start, "symbol ID %d is out of range, it needs to be between 1 and %d", id, MAX_CONSTRAINED_SYMBOL_ID);
+
+	for (s32 i = 0; i < ADDRESS_LENGTH; ++i)
+	{
+		const char* slot_start = reader->cursor;
+		s32 slot;
+		if (!CsvReadField(reader, &slot)) return false;
+		if (slot != 0 && slot != 1) return CsvError(reader, slot_start, "slot %d for symbol ID %d should be 0 or 1, but it's %d", i + 1, id, slot);
+		if (!slot) out->allowed_symbols[i] &= ~(1ull << (id - 1));
+	}
+	return true;
+}
+
+/*
+Loads a constraints file for an already oriented ball, and works out which subdivided triangles each slot allows.
+Symbols above MAX_CONSTRAINED_SYMBOL_ID in the 2D mapping can't be constrained, so they're always allowed.
+
+Returns true if successful. Fails if the file can't be read, or if some slot doesn't allow anything.
+*/
+bool LoadSlotConstraints(const Ball& ball, const char* constraints_path, SlotConstraints* out)
+{
+	// Rows can share a symbol ID, so they're parsed one at a time.
+	for (s32 i = 0; i < ADDRESS_LENGTH; ++i) out->allowed_symbols[i] = ~0ull;
+	s32 row_count;
+	if (!LoadCsv(constraints_path, ParseSlotConstraints, NoCsvAllocation, out, &row_count, nullptr)) return false;
+
+	for (s32 level = 0; level < SUBDIVISION_COUNT; ++level)
+	{
+		u64 allowed = 0;
+		for (s32 tri = 0; tri < SUBDIVIDED_TRIANGLE_COUNT; ++tri)
+		{
+			s32 id = ball.mapping_table[tri];
+			if (id > MAX_CONSTRAINED_SYMBOL_ID || (out->allowed_symbols[level + 1] & (1ull << (id - 1)))) allowed |= 1ull << tri;
+		}
+		out->allowed_triangles[level] = allowed;
+	}
+	static_assert(SUBDIVIDED_TRIANGLE_COUNT <= 64, "Subdivided triangles need to fit in a 64 bit mask.");
+
+	for (s32 i = 0; i < ADDRESS_LENGTH; ++i)
+	{
+		bool any_allowed = (i == 0) ? (out->allowed_symbols[0] & ((1ull << ARRAYCOUNT(ball.faces)) - 1)) : out->allowed_triangles[i - 1];
+		if (!any_allowed)
+		{
+			printf("The constraints file doesn't allow any symbols in slot %d.\n", i + 1);
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+The search itself is a depth first branch and bound. Every triangle fits inside a small cap on the sphere, centered on
+its middle and reaching out to its furthest corner, and every address inside it decodes to somewhere in that cap. So the
+distance from the desired vector to the edge of the cap is the best any address in there could do. We visit the triangles
+with the closest middles first, which finds a good address almost straight away, and then skip anything whose cap is
+further away than that. Sorting by the caps themselves doesn't work as well, since big triangles have big caps, and
+a face can have the desired vector in its cap without being anywhere near it.
+
+Distances are chord lengths between unit vectors rather than angles, same as SearchAddress(). They're in the same order,
+and since they're just distances in 3D, the triangle inequality still works for the caps without any trig.
+
+Disallowed symbols are just missing from the masks, so their whole subtree is skipped without even looking at it.
+*/
+struct ConstrainedSearch
+{
+	const Ball* ball;
+	const SlotConstraints* constraints;
+	Vec3 desired;
+	s32 face; // Face index (symbol ID - 1) we're searching in right now.
+	s32 tris[SUBDIVISION_COUNT]; // Subdivided triangle index at each level, down to the one we're searching in.
+
+	s32 best_face;
+	s32 best_tris[SUBDIVISION_COUNT];
+	double best_distance; // Chord length from the desired vector to the best address so far.
+	Vec3 best_direction; // Decoded direction of the best address so far.
+};
+
+struct ConstrainedCell
+{
+	s64 corners[3][2]; // Same as DecodeAddress().
+	s32 tri;
+	double distance; // Chord length from the desired vector to the middle of the triangle.
+	double bound; // Smallest chord length from the desired vector to anything inside the triangle.
+};
+
+/*
+Works out the radius of the cap around a triangle. Every point of the triangle is within r of its middle on the face,
+so seen from the origin, it's within asin(r / |middle|) of the middle's direction. The middle can't be any closer to the
+origin than the face's plane, and all the triangles at one level are the same shape (upside down ones are just flipped),
+so this radius works for every triangle at the same level as this one. Returns the radius as a chord length.
+*/
+static double GetCapRadius(const Face& face, const s64 corners[3][2])
+{
+	Vec3 centroid = GetCellCentroid(face, corners);
+	double radius_squared = 0.0;
+	for (s32 i = 0; i < 3; ++i)
+	{
+		Vec3 corner = BarycentricToCartesian(Vec2((double)corners[i][0], (double)corners[i][1]) * (1.0 / decode_scale), face.v0, face.v1, face.v2);
+		radius_squared = Max(radius_squared, LengthSquared(corner - centroid));
+	}
+	double plane_distance = Dot(face.normal, face.v0);
+	double cos_angle = Sqrt(Max(1.0 - radius_squared / (plane_distance * plane_distance), 0.0));
+	return Sqrt(2.0 - 2.0 * cos_angle);
+}
+
+// Fills in the distance and bound for a cell, given the radius of its cap from GetCapRadius().
+static void GetCellBound(const Face& face, Vec3 desired, double radius, ConstrainedCell* cell)
+{
+	cell->distance = Length(Normalize(GetCellCentroid(face, cell->corners)) - desired);
+	cell->bound = Max(cell->distance - radius, 0.0);
+}
+
+// Adds a cell to a list sorted from closest to furthest.
+static void InsertSortedCell(ConstrainedCell* cells, s32* count, const ConstrainedCell& cell)
+{
+	s32 i = (*count)++;
+	for (; i > 0 && cells[i - 1].distance > cell.distance; --i) cells[i] = cells[i - 1];
+	cells[i] = cell;
+}
+
+static void SearchConstrainedCell(ConstrainedSearch* search, const s64 corners[3][2], s32 level)
+{
+	const Face& face = search->ball->faces[search->face];
+	ConstrainedCell children[SUBDIVIDED_TRIANGLE_COUNT];
+	s32 child_count = 0;
+
+	s64 first_child[3][2];
+	GetChildCorners(corners, 0, first_child);
+	double radius = GetCapRadius(face, first_child);
+
+	for (u64 mask = search->constraints->allowed_triangles[level]; mask; mask &= mask - 1)
+	{
+		ConstrainedCell child;
+		child.tri = FirstSetBit64(mask);
+		GetChildCorners(corners, child.tri, child.corners);
+
+		// At the last level there's nothing left to bound, the middle of the triangle is where we end up.
+		if (level == SUBDIVISION_COUNT - 1)
+		{
+			Vec3 direction = Normalize(GetCellCentroid(face, child.corners));
+			double distance = Length(direction - search->desired);
+			if (distance < search->best_distance)
+			{
+				search->best_distance = distance;
+				search->best_direction = direction;
+				search->best_face = search->face;
+				memcpy(search->best_tris, search->tris, sizeof(search->tris));
+				search->best_tris[level] = child.tri;
+			}
+			continue;
+		}
+
+		GetCellBound(face, search->desired, radius, &child);
+		if (child.bound < search->best_distance) InsertSortedCell(children, &child_count, child);
+	}
+
+	for (s32 i = 0; i < child_count; ++i)
+	{
+		if (children[i].bound >= search->best_distance) continue;
+		search->tris[level] = children[i].tri;
+		SearchConstrainedCell(search, children[i].corners, level + 1);
+	}
+}
+
+/*
+Finds the address closest to the desired vector that only uses symbols allowed by the constraints, using an already
+oriented ball. Closest means the smallest angle between the decoded direction and the desired vector, same as SearchAddress().
+
+Returns true if successful. If no address could be found, the address is filled with zeroes and we return false.
+*/
+bool SolveConstrainedAddress(const Ball& ball, Vec3 desired, const SlotConstraints& constraints, s32 out_address[ADDRESS_LENGTH], double* out_error)
+{
+	// NaNs never compare as farther than the best so far, so the search would never prune anything.
+	if (!IsValidDirection(desired))
+	{
+		for (s32 i = 0; i < ADDRESS_LENGTH; ++i) out_address[i] = 0;
+		if (out_error) *out_error = 0.0;
+		return false;
+	}
+
+	ConstrainedSearch search = {};
+	search.ball = &ball;
+	search.constraints = &constraints;
+	search.desired = Normalize(desired);
+	search.best_face = -1;
+	search.best_distance = 3.0; // More than any chord on a unit sphere can be.
+
+	// Faces are just the first level of the same search. Faces with a broken basis are skipped, same as SearchAddress().
+	ConstrainedCell faces[ARRAYCOUNT(ball.faces)];
+	s32 face_count = 0;
+	for (u64 mask = constraints.allowed_symbols[0] & ((1ull << ARRAYCOUNT(ball.faces)) - 1); mask; mask &= mask - 1)
+	{
+		ConstrainedCell cell = {};
+		cell.tri = FirstSetBit64(mask);
+		const Face& face = ball.faces[cell.tri];
+		if (LengthSquared(face.inv_basis[0]) == 0.0) continue;
+		cell.corners[1][0] = decode_scale;
+		cell.corners[2][1] = decode_scale;
+		GetCellBound(face, search.desired, GetCapRadius(face, cell.corners), &cell);
+		InsertSortedCell(faces, &face_count, cell);
+	}
+
+	for (s32 i = 0; i < face_count; ++i)
+	{
+		if (faces[i].bound >= search.best_distance) continue;
+		search.face = faces[i].tri;
+		SearchConstrainedCell(&search, faces[i].corners, 0);
+	}
+
+	if (search.best_face < 0)
+	{
+		for (s32 i = 0; i < ADDRESS_LENGTH; ++i) out_address[i] = 0;
+		if (out_error) *out_error = 0.0;
+		return false;
+	}
+
+	out_address[0] = search.best_face + 1;
+	for (s32 i = 0; i < SUBDIVISION_COUNT; ++i) out_address[i + 1] = ball.mapping_table[search.best_tris[i]];
+	if (out_error) *out_error = Angle(search.best_direction, search.desired);
+	return true;
+}
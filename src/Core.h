@@ -8,11 +8,61 @@
 #include <string.h>
 #include <assert.h>
 
+// SIMD intrinsics, if the compiler has been told it can use them (with /arch:AVX2 or /arch:AVX512 for MSVC).
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 #include "GMath.h"
+#include "GMathBatch.h"
 
 // Integer typedefs
+typedef int8_t s8;
+typedef int16_t s16;
 typedef int32_t s32;
 typedef int64_t s64;
+typedef uint8_t u8;
+typedef uint32_t u32;
+typedef uint64_t u64;
 
 // To get array length. Doesn't work for empty arrays, or anything that has been cast to a pointer.
-#define ARRAYCOUNT(x) (sizeof(x) / sizeof(x[0]))
\ No newline at end of file
+#define ARRAYCOUNT(x) (sizeof(x) / sizeof(x[0]))
+
+// Index of the lowest set bit in a mask. The mask must not be zero.
+inline s32 FirstSetBit(u32 mask)
+{
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanForward(&idx, mask);
+	return (s32)idx;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+// Same as the other FirstSetBit(), but for 64 bit masks.
+inline s32 FirstSetBit64(u64 mask)
+{
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanForward64(&idx, mask);
+	return (s32)idx;
+#else
+	return __builtin_ctzll(mask);
+#endif
+}
+
+// Index of the highest set bit in a mask. The mask must not be zero.
+inline s32 LastSetBit64(u64 mask)
+{
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanReverse64(&idx, mask);
+	return (s32)idx;
+#else
+	return 63 - __builtin_clzll(mask);
+#endif
+}
\ No newline at end of file
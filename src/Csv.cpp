@@ -0,0 +1,415 @@
+#include "Core.h"
+
+#include <charconv>
+#include <stdarg.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+Every input file is a CSV of numbers, and some of them (queries and burbs especially) can be huge. So instead of going through
+fscanf one field at a time, we map the whole file into memory and parse the numbers straight out of it with std::from_chars.
+
+Big files are split into chunks on line boundaries, and parsed on every thread. That takes two passes, since we need to know
+how many rows come before a chunk to know where its rows go: the first one counts the rows in each chunk, and the second parses them.
+*/
+
+// Roughly how many bytes of the file each thread parses at a time. Chunks always end on a line boundary.
+#define CSV_CHUNK_SIZE (1 << 20)
+
+struct CsvFile
+{
+	const char* path;
+	const char* data; // The whole file, mapped into memory. It isn't null terminated!
+	s64 size;
+	s64 rows_begin; // Offset of the first row after the header, or 0 if there isn't a header.
+	s64 first_line; // Line number of the line at rows_begin, starting from 1.
+};
+
+// Reads the fields of one row at a time. If anything goes wrong, the error message says exactly where.
+struct CsvReader
+{
+	const CsvFile* file;
+	const char* cursor;
+	const char* end;
+	const char* line_start;
+	s64 line; // Line number of the current row, starting from 1.
+	char error[256];
+};
+
+static bool IsCsvSpace(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+static bool IsCsvLineEnd(char c)
+{
+	return c == '\n' || c == '\r';
+}
+
+// Returns the start of the next line, or end if this is the last line.
+static const char* SkipCsvLine(const char* p, const char* end)
+{
+	const char* newline = (const char*)memchr(p, '\n', end - p);
+	return newline ? newline + 1 : end;
+}
+
+// Whether a line is empty or only has whitespace in it.
+static bool IsCsvLineBlank(const char* p, const char* end)
+{
+	while (p < end && (IsCsvSpace(*p) || *p == '\r')) ++p;
+	return p == end || *p == '\n';
+}
+
+/*
+Maps a whole file into memory, read only. Every process that maps the same file shares the same pages.
+Prints an error and returns false if the file can't be read. Empty files give a null pointer and a size of 0.
+The file must be unmapped with UnmapFile() afterwards.
+*/
+bool MapFile(const char* path, const char** out_data, s64* out_size)
+{
+	*out_data = nullptr;
+	*out_size = 0;
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		printf("Unable to open file %s\n", path);
+		return false;
+	}
+	LARGE_INTEGER size = {};
+	GetFileSizeEx(file, &size);
+	*out_size = size.QuadPart;
+	if (*out_size > 0)
+	{
+		// The view keeps the file mapped after the handles are closed.
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping)
+		{
+			*out_data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping);
+		}
+	}
+	CloseHandle(file);
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		printf("Unable to open file %s\n", path);
+		return false;
+	}
+	struct stat st = {};
+	fstat(fd, &st);
+	*out_size = (s64)st.st_size;
+	if (*out_size > 0)
+	{
+		void* data = mmap(nullptr, (size_t)*out_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data != MAP_FAILED) *out_data = (const char*)data;
+	}
+	close(fd);
+#endif
+
+	if (*out_size > 0 && !*out_data)
+	{
+		printf("Unable to map file %s into memory\n", path);
+		*out_size = 0;
+		return false;
+	}
+	return true;
+}
+
+void UnmapFile(const char* data, s64 size)
+{
+	if (!data) return;
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+#else
+	munmap((void*)data, (size_t)size);
+#endif
+}
+
+/*
+Maps a CSV file into memory. The first line can optionally be a header, which is detected here once: every row we parse
+starts with a number, so if the first line doesn't, it's a header. Prints an error and returns false if the file can't be read.
+The file must be closed with CloseCsv() afterwards.
+*/
+bool OpenCsv(const char* path, CsvFile* out)
+{
+	*out = {};
+	out->path = path;
+	out->first_line = 1;
+	if (!MapFile(path, &out->data, &out->size)) return false;
+
+	const char* end = out->data + out->size;
+	const char* p = out->data;
+	while (p < end && IsCsvSpace(*p)) ++p;
+	bool has_header = p < end && !((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' || *p == '.');
+	if (has_header)
+	{
+		out->rows_begin = SkipCsvLine(out->data, end) - out->data;
+		out->first_line = 2;
+	}
+	TRACE(TRACE_PARSING, TRACE_STAGE, "Opened %s (%lld bytes, %s)", path, (long long)out->size, has_header ? "with a header" : "no header");
+	return true;
+}
+
+void CloseCsv(CsvFile* file)
+{
+	UnmapFile(file->data, file->size);
+	*file = {};
+}
+
+// Records an error at a position in the current row. Always returns false, so parsers can just return it.
+static bool CsvError(CsvReader* reader, const char* at, const char* format, ...)
+{
+	char message[192];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(message, sizeof(message), format, args);
+	va_end(args);
+	snprintf(reader->error, sizeof(reader->error), "Unable to parse %s at line %lld, column %lld: %s", reader->file->path, (long long)reader->line, (long long)(at - reader->line_start + 1), message);
+	return false;
+}
+
+/*
+Reads one number from the current row, along with the comma after it. Spaces around the number are fine, and so is
+a leading plus sign. Works for s32 and double.
+*/
+template <typename T>
+static bool CsvReadField(CsvReader* reader, T* out)
+{
+	const char* p = reader->cursor;
+	while (p < reader->end && IsCsvSpace(*p)) ++p;
+	if (p < reader->end && *p == '+') ++p;
+
+	std::from_chars_result result = std::from_chars(p, reader->end, *out);
+	if (result.ec == std::errc::result_out_of_range) return CsvError(reader, p, "number out of range");
+	if (result.ec != std::errc()) return CsvError(reader, p, "expected a number");
+
+	p = result.ptr;
+	while (p < reader->end && IsCsvSpace(*p)) ++p;
+	if (p < reader->end && *p == ',') ++p;
+	else if (p < reader->end && !IsCsvLineEnd(*p)) return CsvError(reader, p, "expected a comma");
+	reader->cursor = p;
+	return true;
+}
+
+static bool CsvReadVec3(CsvReader* reader, Vec3* out)
+{
+	return CsvReadField(reader, &out->x) && CsvReadField(reader, &out->y) && CsvReadField(reader, &out->z);
+}
+
+// Whether there are no fields left in the current row.
+static bool CsvAtRowEnd(const CsvReader* reader)
+{
+	const char* p = reader->cursor;
+	while (p < reader->end && IsCsvSpace(*p)) ++p;
+	return p == reader->end || IsCsvLineEnd(*p);
+}
+
+/*
+Parses one row of a CSV file. The reader is at the start of the row, and row is its index, not counting blank lines or the header.
+Returns false if the row can't be parsed, after calling CsvError().
+*/
+typedef bool CsvRowParser(CsvReader* reader, void* data, s32 row);
+
+// Called once with the number of rows in the file, before any of them are parsed.
+typedef void CsvRowAllocator(void* data, s32 row_count);
+
+struct CsvChunk
+{
+	s64 begin;
+	s64 end;
+	s32 first_row; // Index of the first row in the chunk.
+	s32 row_count;
+	s64 first_line; // Line number at the start of the chunk.
+	s64 line_count;
+	s32 error_row; // Index of the row that failed to parse, or -1.
+	char error[256];
+};
+
+struct CsvJob
+{
+	const CsvFile* file;
+	CsvChunk* chunks;
+	CsvRowParser* parse_row;
+	void* data;
+};
+
+static void CountCsvRowsChunk(void* data, s32 begin, s32 end)
+{
+	CsvJob* job = (CsvJob*)data;
+	const char* file_end = job->file->data + job->file->size;
+	for (s32 c = begin; c < end; ++c)
+	{
+		CsvChunk& chunk = job->chunks[c];
+		const char* p = job->file->data + chunk.begin;
+		const char* chunk_end = job->file->data + chunk.end;
+		s32 rows = 0;
+		s64 lines = 0;
+		while (p < chunk_end)
+		{
+			if (!IsCsvLineBlank(p, file_end)) ++rows;
+			p = SkipCsvLine(p, file_end);
+			++lines;
+		}
+		chunk.row_count = rows;
+		chunk.line_count = lines;
+	}
+}
+
+/*
+Parses the rows of one chunk from SplitCsv(), numbering them starting from first_row. That's usually chunk->first_row,
+but it can be anything, for when the rows go somewhere that only has room for this chunk.
+Returns false if a row can't be parsed, with its index in the whole file in chunk->error_row, and the message in chunk->error.
+*/
+static bool ParseCsvRows(const CsvFile& file, CsvChunk* chunk, CsvRowParser* parse_row, void* data, s32 first_row)
+{
+	CsvReader reader = {};
+	reader.file = &file;
+	reader.cursor = file.data + chunk->begin;
+	reader.end = file.data + file.size;
+	reader.line = chunk->first_line;
+
+	const char* chunk_end = file.data + chunk->end;
+	s32 row = first_row;
+	while (reader.cursor < chunk_end)
+	{
+		reader.line_start = reader.cursor;
+		if (!IsCsvLineBlank(reader.cursor, reader.end))
+		{
+			bool parsed = parse_row(&reader, data, row);
+			if (parsed && !CsvAtRowEnd(&reader)) parsed = CsvError(&reader, reader.cursor, "too many fields");
+			if (!parsed)
+			{
+				chunk->error_row = chunk->first_row + (row - first_row);
+				memcpy(chunk->error, reader.error, sizeof(chunk->error));
+				return false;
+			}
+			++row;
+		}
+		reader.cursor = SkipCsvLine(reader.line_start, reader.end);
+		++reader.line;
+	}
+	return true;
+}
+
+static void ParseCsvChunk(void* data, s32 begin, s32 end)
+{
+	CsvJob* job = (CsvJob*)data;
+	for (s32 c = begin; c < end; ++c) ParseCsvRows(*job->file, &job->chunks[c], job->parse_row, job->data, job->chunks[c].first_row);
+}
+
+/*
+Splits the rows of an open CSV file into chunks on line boundaries, and counts the rows in each one, on every thread in the
+pool if one is given. Each chunk knows its first row and line number, so they can all be parsed independently.
+Returns the chunks, which must be freed by the caller.
+*/
+static CsvChunk* SplitCsv(const CsvFile& file, ThreadPool* pool, s32* out_chunk_count, s32* out_row_count)
+{
+	// Move each split forward to the start of the next line.
+	s64 rows_size = file.size - file.rows_begin;
+	s32 chunk_count = (rows_size > 0) ? (s32)((rows_size + CSV_CHUNK_SIZE - 1) / CSV_CHUNK_SIZE) : 1;
+	CsvChunk* chunks = (CsvChunk*)malloc(chunk_count * sizeof(CsvChunk));
+	const char* file_end = file.data + file.size;
+	s64 split = file.rows_begin;
+	for (s32 i = 0; i < chunk_count; ++i)
+	{
+		chunks[i].begin = split;
+		s64 target = file.rows_begin + (s64)(i + 1) * CSV_CHUNK_SIZE;
+		if (i == chunk_count - 1) split = file.size;
+		else if (target > split) split = SkipCsvLine(file.data + target - 1, file_end) - file.data;
+		chunks[i].end = split;
+		chunks[i].error_row = -1;
+	}
+
+	CsvJob job = {};
+	job.file = &file;
+	job.chunks = chunks;
+	if (pool) RunParallel(pool, chunk_count, 1, CountCsvRowsChunk, &job);
+	else CountCsvRowsChunk(&job, 0, chunk_count);
+
+	s32 row_count = 0;
+	s64 line = file.first_line;
+	for (s32 i = 0; i < chunk_count; ++i)
+	{
+		chunks[i].first_row = row_count;
+		chunks[i].first_line = line;
+		row_count += chunks[i].row_count;
+		line += chunks[i].line_count;
+	}
+
+	TRACE(TRACE_PARSING, TRACE_DETAIL, "Split %s into %d chunks, with %d rows", file.path, chunk_count, row_count);
+	*out_chunk_count = chunk_count;
+	*out_row_count = row_count;
+	return chunks;
+}
+
+/*
+Parses every row of an open CSV file, on every thread in the pool if one is given. Blank lines are skipped.
+The allocator gets called first with the number of rows, and then parse_row gets called for each one. Rows can be
+parsed in any order, on any thread, so parse_row should only write to its own row. Without a pool, the rows go in order.
+
+If a row can't be parsed, we print the error for the first one that failed, and return false. out_row_count is set to the
+number of rows before that one, which have all been parsed successfully.
+*/
+bool ParseCsv(const CsvFile& file, CsvRowParser* parse_row, CsvRowAllocator* allocate, void* data, s32* out_row_count, ThreadPool* pool)
+{
+	s32 chunk_count;
+	s32 row_count;
+	CsvChunk* chunks = SplitCsv(file, pool, &chunk_count, &row_count);
+
+	CsvJob job;
+	job.file = &file;
+	job.chunks = chunks;
+	job.parse_row = parse_row;
+	job.data = data;
+
+	allocate(data, row_count);
+	if (pool) RunParallel(pool, chunk_count, 1, ParseCsvChunk, &job);
+	else ParseCsvChunk(&job, 0, chunk_count);
+
+	bool success = true;
+	for (s32 i = 0; i < chunk_count; ++i)
+	{
+		if (chunks[i].error_row < 0) continue;
+		printf("%s\n", chunks[i].error);
+		row_count = chunks[i].error_row;
+		success = false;
+		break;
+	}
+
+	free(chunks);
+	*out_row_count = row_count;
+	return success;
+}
+
+// Opens, parses and closes a CSV file in one go, see ParseCsv().
+bool LoadCsv(const char* path, CsvRowParser* parse_row, CsvRowAllocator* allocate, void* data, s32* out_row_count, ThreadPool* pool)
+{
+	s64 start = StartMetricsTimer();
+	CsvFile file;
+	if (!OpenCsv(path, &file))
+	{
+		*out_row_count = 0;
+		return false;
+	}
+	bool success = ParseCsv(file, parse_row, allocate, data, out_row_count, pool);
+	CloseCsv(&file);
+	RecordLatency(METRIC_CSV_LOAD, start);
+	return success;
+}
+
+// For small files that go into fixed size arrays, where the row parser checks the row index itself.
+static void NoCsvAllocation(void* data, s32 row_count)
+{
+}
@@ -0,0 +1,239 @@
+#include "Core.h"
+
+#include <atomic>
+
+/*
+Decoding goes the other way from SolveAddress(), turning an 8 symbol address back into a direction.
+The first symbol picks the face, and each of the other 7 picks one of the 64 triangles inside the previous one.
+
+We walk down the subdivisions with integer barycentric coordinates, scaled so that the smallest triangles have
+a side length of 1. That way every corner is exact, and we only convert to a direction once at the very end.
+*/
+
+static constexpr s64 GetDecodeScale()
+{
+	s64 scale = 1;
+	for (s32 i = 0; i < SUBDIVISION_COUNT; ++i) scale *= SUBDIVISION_AMOUNT;
+	return scale;
+}
+
+// Length of a face side in the integer coordinates used by DecodeAddress().
+static constexpr s64 decode_scale = GetDecodeScale();
+
+struct DecodedAddress
+{
+	Vec3 centroid; // Direction to the middle of the smallest triangle.
+	Vec3 corners[3]; // Directions to each corner of the smallest triangle, in the same order as subdivision_tables<SUBDIVISION_AMOUNT>.triangles.
+	double error; // Angle in radians between the centroid and the target, if there was one.
+};
+
+/*
+Finds the corners of one of the subdivided triangles inside a larger one, in the integer coordinates used by DecodeAddress().
+The corners of the larger triangle are all on the grid for this level, so this is exact.
+*/
+static void GetChildCorners(const s64 corners[3][2], s32 tri, s64 out_corners[3][2])
+{
+	s64 e1[2] = {(corners[1][0] - corners[0][0]) / SUBDIVISION_AMOUNT, (corners[1][1] - corners[0][1]) / SUBDIVISION_AMOUNT};
+	s64 e2[2] = {(corners[2][0] - corners[0][0]) / SUBDIVISION_AMOUNT, (corners[2][1] - corners[0][1]) / SUBDIVISION_AMOUNT};
+	for (s32 i = 0; i < 3; ++i)
+	{
+		const s8* grid = subdivision_tables<SUBDIVISION_AMOUNT>.corners[tri][i];
+		out_corners[i][0] = corners[0][0] + e1[0] * grid[0] + e2[0] * grid[1];
+		out_corners[i][1] = corners[0][1] + e1[1] * grid[0] + e2[1] * grid[1];
+	}
+}
+
+// Converts integer barycentric coordinates from DecodeAddress() into a direction.
+static Vec3 GetDecodedDirection(const Face& face, double u, double v)
+{
+	return Normalize(BarycentricToCartesian(Vec2(u, v) * (1.0 / decode_scale), face.v0, face.v1, face.v2));
+}
+
+/*
+Finds the triangle an address refers to, using an already oriented ball. If a target is given,
+we also work out how far the centroid is from it, otherwise the error is set to zero.
+
+Returns false if the address has symbols which can't be in that position.
+*/
+bool DecodeAddress(const Ball& ball, const s32 address[ADDRESS_LENGTH], const Vec3* target, DecodedAddress* out)
+{
+	if (address[0] < 1 || address[0] > (s32)ARRAYCOUNT(ball.faces)) return false;
+	const Face& face = ball.faces[address[0] - 1];
+
+	// Corners of the current triangle, as (u, v) towards face.v1 and face.v2.
+	s64 corners[3][2] = {{0, 0}, {decode_scale, 0}, {0, decode_scale}};
+	for (s32 level = 0; level < SUBDIVISION_COUNT; ++level)
+	{
+		s32 id = address[level + 1];
+		s32 tri = (id >= 0 && id <= MAX_SYMBOL_ID) ? ball.triangle_from_symbol[id] : -1;
+		if (tri < 0) return false;
+
+		s64 parent[3][2];
+		memcpy(parent, corners, sizeof(corners));
+		GetChildCorners(parent, tri, corners);
+	}
+
+	for (s32 i = 0; i < 3; ++i) out->corners[i] = GetDecodedDirection(face, (double)corners[i][0], (double)corners[i][1]);
+	double centroid_u = (double)(corners[0][0] + corners[1][0] + corners[2][0]) / 3.0;
+	double centroid_v = (double)(corners[0][1] + corners[1][1] + corners[2][1]) / 3.0;
+	out->centroid = GetDecodedDirection(face, centroid_u, centroid_v);
+	out->error = target ? Angle(out->centroid, Normalize(*target)) : 0.0;
+	return true;
+}
+
+// Number of addresses each thread decodes at a time in DecodeAddresses().
+#define DECODE_CHUNK_SIZE 1024
+
+struct DecodeAddressesJob
+{
+	const Ball* ball;
+	const s32 (*addresses)[ADDRESS_LENGTH];
+	const Vec3* targets;
+	const bool* has_target;
+	DecodedAddress* out;
+	bool* out_valid;
+	std::atomic<s32> valid_count;
+};
+
+static void DecodeAddressesChunk(void* data, s32 begin, s32 end)
+{
+	DecodeAddressesJob* job = (DecodeAddressesJob*)data;
+	s32 valid_count = 0;
+	for (s32 i = begin; i < end; ++i)
+	{
+		const Vec3* target = (job->targets && job->has_target[i]) ? &job->targets[i] : nullptr;
+		job->out_valid[i] = DecodeAddress(*job->ball, job->addresses[i], target, &job->out[i]);
+		if (job->out_valid[i]) ++valid_count;
+	}
+	job->valid_count += valid_count;
+}
+
+/*
+Decodes a whole list of addresses, on every thread in the pool if one is given. Targets can be nullptr if there
+aren't any, otherwise has_target says which addresses have one. out_valid is set to false for invalid addresses.
+
+Returns the number of addresses that were valid.
+*/
+s32 DecodeAddresses(const Ball& ball, const s32 (*addresses)[ADDRESS_LENGTH], const Vec3* targets, const bool* has_target, s32 count, DecodedAddress* out, bool* out_valid, ThreadPool* pool)
+{
+	DecodeAddressesJob job;
+	job.ball = &ball;
+	job.addresses = addresses;
+	job.targets = targets;
+	job.has_target = has_target;
+	job.out = out;
+	job.out_valid = out_valid;
+	job.valid_count = 0;
+
+	if (pool) RunParallel(pool, count, DECODE_CHUNK_SIZE, DecodeAddressesChunk, &job);
+	else DecodeAddressesChunk(&job, 0, count);
+	return job.valid_count;
+}
+
+// Everything ParseAddresses() reads, with one entry per row.
+struct AddressRows
+{
+	s32 (*addresses)[ADDRESS_LENGTH];
+	Vec3* targets;
+	bool* has_target;
+};
+
+/*
+Parses a CSV file of addresses, one per row, formatted as 8 symbol IDs. Each row can optionally have a target
+vector after the address, formatted as X,Y,Z. The first row can optionally be a header, which will be skipped.
+*/
+static bool ParseAddresses(CsvReader* reader, void* data, s32 row)
+{
+	AddressRows* rows = (AddressRows*)data;
+	for (s32 i = 0; i < ADDRESS_LENGTH; ++i)
+	{
+		if (!CsvReadField(reader, &rows->addresses[row][i])) return false;
+	}
+
+	rows->targets[row] = {};
+	rows->has_target[row] = !CsvAtRowEnd(reader);
+	return !rows->has_target[row] || CsvReadVec3(reader, &rows->targets[row]);
+}
+
+static void AllocateAddresses(void* data, s32 row_count)
+{
+	AddressRows* rows = (AddressRows*)data;
+	rows->addresses = (s32 (*)[ADDRESS_LENGTH])malloc(row_count * sizeof(*rows->addresses));
+	rows->targets = (Vec3*)malloc(row_count * sizeof(Vec3));
+	rows->has_target = (bool*)malloc(row_count * sizeof(bool));
+}
+
+/*
+Decodes every address in a CSV file, and prints the centroid and corner directions as CSV rows, along with the
+error in radians for rows that had a target. See ParseAddresses() for the input format, and RunBatch() for the other arguments.
+Invalid addresses are printed with all zeroes, and an error of -1.
+
+Returns 0 if successful, or 1 if an error occured when reading/parsing the files.
+*/
+s32 RunDecode(s32 id1, s32 id2, const char* addresses_path, const char* mapping_3d_path, const char* starmap_path, const char* mapping_2d_path, s32 thread_count)
+{
+	Ball ball = {};
+	if (!LoadBall(id1, id2, mapping_3d_path, starmap_path, mapping_2d_path, &ball)) return 1;
+
+	ThreadPool pool;
+	StartThreadPool(&pool, thread_count);
+	AddressRows rows = {};
+	s32 count;
+	if (!LoadCsv(addresses_path, ParseAddresses, AllocateAddresses, &rows, &count, &pool))
+	{
+		StopThreadPool(&pool);
+		free(rows.addresses);
+		free(rows.targets);
+		free(rows.has_target);
+		return 1;
+	}
+	s32 (*addresses)[ADDRESS_LENGTH] = rows.addresses;
+	Vec3* targets = rows.targets;
+	bool* has_target = rows.has_target;
+
+	DecodedAddress* decoded = (DecodedAddress*)malloc(count * sizeof(DecodedAddress));
+	bool* valid = (bool*)malloc(count * sizeof(bool));
+	DecodeAddresses(ball, addresses, targets, has_target, count, decoded, valid, &pool);
+	StopThreadPool(&pool);
+
+	OutputWriter output;
+	StartOutput(&output, stdout, output_format);
+	AddOutputColumn(&output, "Index");
+	AddOutputColumn(&output, "Centroid X");
+	AddOutputColumn(&output, "Centroid Y");
+	AddOutputColumn(&output, "Centroid Z");
+	for (s32 j = 0; j < 3; ++j)
+	{
+		AddOutputColumn(&output, "Corner %d X", j + 1);
+		AddOutputColumn(&output, "Corner %d Y", j + 1);
+		AddOutputColumn(&output, "Corner %d Z", j + 1);
+	}
+	AddOutputColumn(&output, "Error");
+	WriteOutputHeader(&output);
+	for (s32 i = 0; i < count; ++i)
+	{
+		DecodedAddress d = valid[i] ? decoded[i] : DecodedAddress{};
+		WriteOutputInt(&output, i);
+		WriteOutputDouble(&output, d.centroid.x, 15);
+		WriteOutputDouble(&output, d.centroid.y, 15);
+		WriteOutputDouble(&output, d.centroid.z, 15);
+		for (s32 j = 0; j < 3; ++j)
+		{
+			WriteOutputDouble(&output, d.corners[j].x, 15);
+			WriteOutputDouble(&output, d.corners[j].y, 15);
+			WriteOutputDouble(&output, d.corners[j].z, 15);
+		}
+		if (!valid[i]) WriteOutputInt(&output, -1);
+		else if (has_target[i]) WriteOutputDoubleSignificant(&output, d.error, 15);
+		else WriteOutputEmpty(&output);
+		EndOutputRow(&output);
+	}
+	FinishOutput(&output);
+
+	free(valid);
+	free(decoded);
+	free(has_target);
+	free(targets);
+	free(addresses);
+	return 0;
+}
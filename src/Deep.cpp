@@ -0,0 +1,300 @@
+#include "Core.h"
+
+#include <atomic>
+
+/*
+The stargate only takes 7 levels of subdivision, but modded gates can take more, and it's handy to see how the address
+would keep going for working out how precise our vectors need to be. Going deeper doesn't work with SolveViaFixedPoint(),
+since 8^7 already uses 21 bits of the double, and everything past about 17 levels is just rounding error.
+
+So for deep addresses, the barycentric coordinates are worked out in double-double arithmetic (an unevaluated sum of two
+doubles, so about 106 bits), and then scaled and rounded down into 128 bit integers. After that it's exactly the same shifts,
+masks and table lookups as SolveViaFixedPoint(). Addresses up to 7 levels deep still go through SolveViaFixedPoint(), so
+those are just as fast as before.
+*/
+
+// Number of bits in each digit of the barycentric indices, see GetSubdivisionBits().
+static constexpr s32 deep_digit_bits = GetSubdivisionBits<SUBDIVISION_AMOUNT>();
+static_assert(deep_digit_bits > 0, "The deep solver splits the 128 bit barycentric indices into digits with shifts and masks, so SUBDIVISION_AMOUNT has to be a power of two.");
+
+// Bits of the integers that get filled in. Double-double still gets all 96 right, but not much more than that.
+#define DEEP_FIXED_POINT_BITS 96
+
+// Deepest address SolveDeepAddress() can find, as many levels as fit in the bits above. That's 32 levels when the factor is 8.
+// The bit count is kept positive here so that the static_assert above is the only error when it isn't.
+#define MAX_DEEP_SUBDIVISION_COUNT (DEEP_FIXED_POINT_BITS / ((deep_digit_bits > 0) ? deep_digit_bits : 1))
+#define MAX_DEEP_ADDRESS_LENGTH (MAX_DEEP_SUBDIVISION_COUNT + 1)
+
+// A number stored as hi + lo, where lo is less than half a unit in the last place of hi.
+struct DoubleDouble
+{
+	double hi;
+	double lo;
+};
+
+// Adds two doubles exactly. Needs strict IEEE rounding, so don't build with /fp:fast (or -ffast-math).
+static DoubleDouble TwoSum(double a, double b)
+{
+	double s = a + b;
+	double b_part = s - a;
+	double a_part = s - b_part;
+	return {s, (a - a_part) + (b - b_part)};
+}
+
+// Same as TwoSum(), but only works if |a| >= |b|.
+static DoubleDouble QuickTwoSum(double a, double b)
+{
+	double s = a + b;
+	return {s, b - (s - a)};
+}
+
+// Multiplies two doubles exactly. fma() rounds once, so it gives us exactly the part that a * b rounded off.
+static DoubleDouble TwoProduct(double a, double b)
+{
+	double p = a * b;
+	return {p, fma(a, b, -p)};
+}
+
+static DoubleDouble operator+(DoubleDouble a, DoubleDouble b)
+{
+	DoubleDouble s = TwoSum(a.hi, b.hi);
+	DoubleDouble t = TwoSum(a.lo, b.lo);
+	s = QuickTwoSum(s.hi, s.lo + t.hi);
+	return QuickTwoSum(s.hi, s.lo + t.lo);
+}
+
+static DoubleDouble operator-(DoubleDouble a, DoubleDouble b)
+{
+	return a + DoubleDouble{-b.hi, -b.lo};
+}
+
+static DoubleDouble operator*(DoubleDouble a, double b)
+{
+	DoubleDouble p = TwoProduct(a.hi, b);
+	return QuickTwoSum(p.hi, p.lo + a.lo * b);
+}
+
+// Long division, one double at a time.
+static DoubleDouble operator/(DoubleDouble a, DoubleDouble b)
+{
+	double q1 = a.hi / b.hi;
+	DoubleDouble r = a - b * q1;
+	double q2 = r.hi / b.hi;
+	r = r - b * q2;
+	double q3 = r.hi / b.hi;
+	return QuickTwoSum(q1, q2) + DoubleDouble{q3, 0.0};
+}
+
+// a . (b x c), which is the determinant of the three vectors. Every product is exact, so only the sums round.
+static DoubleDouble TripleProduct(Vec3 a, Vec3 b, Vec3 c)
+{
+	DoubleDouble x = TwoProduct(b.y, c.z) - TwoProduct(b.z, c.y);
+	DoubleDouble y = TwoProduct(b.z, c.x) - TwoProduct(b.x, c.z);
+	DoubleDouble z = TwoProduct(b.x, c.y) - TwoProduct(b.y, c.x);
+	return x * a.x + y * a.y + z * a.z;
+}
+
+// MSVC doesn't have a 128 bit integer type, so we only implement the handful of operations we need.
+struct U128
+{
+	u64 lo;
+	u64 hi;
+};
+
+// Converts a double that's already a whole number (and not negative) into an integer.
+static U128 WholeDoubleToU128(double x)
+{
+	double hi = floor(ldexp(x, -64));
+	double lo = x - ldexp(hi, 64); // Exact, since it's just the low bits of x.
+	return {(u64)lo, (u64)hi};
+}
+
+static U128 AddSigned(U128 a, s64 b)
+{
+	U128 r;
+	r.lo = a.lo + (u64)b;
+	if (b >= 0) r.hi = a.hi + (r.lo < a.lo ? 1 : 0);
+	else r.hi = a.hi - (r.lo > a.lo ? 1 : 0);
+	return r;
+}
+
+// One digit (deep_digit_bits bits) of an integer, starting at bit shift.
+static s32 GetDigit(U128 x, s32 shift)
+{
+	u64 bits;
+	if (shift >= 64) bits = x.hi >> (shift - 64);
+	else if (shift == 0) bits = x.lo;
+	else bits = (x.lo >> shift) | (x.hi << (64 - shift));
+	return (s32)(bits & ((1ull << deep_digit_bits) - 1));
+}
+
+/*
+Rounds value * 2^bits down to an integer. The scaling is exact, but hi and lo have to be rounded down together, since lo
+can tip a whole number hi over to the one below. Tiny negative values round up to 0, same as SolveViaFixedPoint().
+Returns false if the value is any more negative than that.
+*/
+static bool ToFixedPoint(DoubleDouble value, s32 bits, U128* out)
+{
+	if (value.hi < 0.0 || (value.hi == 0.0 && value.lo < 0.0))
+	{
+		if (ldexp(value.hi, bits) <= -1.0) return false;
+		*out = {0, 0};
+		return true;
+	}
+
+	double hi = ldexp(value.hi, bits);
+	double whole = floor(hi);
+	DoubleDouble rest = TwoSum(hi - whole, ldexp(value.lo, bits));
+	double rest_whole = floor(rest.hi);
+	if (rest_whole == rest.hi && rest.lo < 0.0) rest_whole -= 1.0;
+
+	*out = AddSigned(WholeDoubleToU128(whole), (s64)rest_whole);
+	return true;
+}
+
+/*
+Same as SolveViaFixedPoint(), but for any depth up to MAX_DEEP_SUBDIVISION_COUNT. The barycentric coordinates come straight
+from the face's corners with Cramer's rule, rather than from inv_basis, which was only ever rounded to doubles.
+
+Returns false if the desired vector isn't on the face, or the indices don't form a triangle (which shouldn't happen).
+*/
+bool SolveViaDoubleDouble(Vec3 desired, const Face& face, s32 depth, s32 out_indices[MAX_DEEP_SUBDIVISION_COUNT])
+{
+	DoubleDouble w0 = TripleProduct(desired, face.v1, face.v2);
+	DoubleDouble w1 = TripleProduct(face.v0, desired, face.v2);
+	DoubleDouble w2 = TripleProduct(face.v0, face.v1, desired);
+	DoubleDouble sum = w0 + w1 + w2;
+	if (sum.hi == 0.0) return false;
+
+	DoubleDouble u = w1 / sum;
+	DoubleDouble v = w2 / sum;
+	DoubleDouble w = DoubleDouble{1.0, 0.0} - u - v;
+
+	s32 bits = deep_digit_bits * depth;
+	U128 x, y, z;
+	if (!ToFixedPoint(u, bits, &x) || !ToFixedPoint(v, bits, &y) || !ToFixedPoint(w, bits, &z)) return false;
+
+	s32 invalid = 0;
+	for (s32 i = 0; i < depth; ++i)
+	{
+		s32 shift = deep_digit_bits * i;
+		s32 tri = subdivision_tables<SUBDIVISION_AMOUNT>.digits[GetDigit(x, shift)][GetDigit(y, shift)][GetDigit(z, shift)];
+		invalid |= tri;
+		out_indices[depth - 1 - i] = tri;
+	}
+	return invalid >= 0;
+}
+
+/*
+Solves an address with depth levels of subdivision after the first symbol, using an already oriented ball. The depth
+can be anything from 1 to MAX_DEEP_SUBDIVISION_COUNT, and the address has depth + 1 symbols. The first 7 levels of a deep
+address are the same as SolveAddress(), apart from vectors within rounding error of a triangle's edge.
+
+Returns true if successful. If the vector couldn't be solved, the address is filled with zeroes and we return false.
+*/
+bool SolveDeepAddress(const Ball& ball, Vec3 desired, s32 depth, s32 out_address[MAX_DEEP_ADDRESS_LENGTH])
+{
+	if (depth < 1 || depth > MAX_DEEP_SUBDIVISION_COUNT)
+	{
+		for (s32 i = 0; i < MAX_DEEP_ADDRESS_LENGTH; ++i) out_address[i] = 0;
+		return false;
+	}
+
+	// The coarser levels are just the top bits, so short addresses are the start of the 7 level one.
+	s32 indices[MAX_DEEP_SUBDIVISION_COUNT];
+	CountMetric(METRIC_QUERIES);
+	s32 first_symbol = FindFirstSymbol(ball, desired);
+	s64 start = StartMetricsTimer();
+	bool solved = first_symbol != 0;
+	if (solved && depth <= SUBDIVISION_COUNT) solved = SolveViaFixedPoint<SUBDIVISION_AMOUNT, SUBDIVISION_COUNT>(desired, ball.faces[first_symbol - 1], indices);
+	else if (solved) solved = SolveViaDoubleDouble(desired, ball.faces[first_symbol - 1], depth, indices);
+	if (first_symbol) RecordLatency(METRIC_DESCENT, start);
+	if (!solved)
+	{
+		CountMetric(METRIC_UNSOLVED);
+		for (s32 i = 0; i <= depth; ++i) out_address[i] = 0;
+		return false;
+	}
+
+	out_address[0] = first_symbol;
+	for (s32 i = 0; i < depth; ++i) out_address[i + 1] = ball.mapping_table[indices[i]];
+	return true;
+}
+
+struct SolveDeepAddressesJob
+{
+	const Ball* ball;
+	Vec3Batch desired;
+	s32 depth;
+	s32 (*out_addresses)[MAX_DEEP_ADDRESS_LENGTH];
+	std::atomic<s32> solved_count;
+};
+
+static void SolveDeepAddressesChunk(void* data, s32 begin, s32 end)
+{
+	SolveDeepAddressesJob* job = (SolveDeepAddressesJob*)data;
+	Vec3Batch desired = job->desired.Slice(begin, end - begin);
+	desired.Assign(Normalize(desired));
+
+	s32 solved_count = 0;
+	for (s32 i = 0; i < desired.count; ++i)
+	{
+		if (SolveDeepAddress(*job->ball, desired[i], job->depth, job->out_addresses[begin + i])) ++solved_count;
+	}
+	job->solved_count += solved_count;
+}
+
+/*
+Same as RunBatch(), but every address has depth levels of subdivision, see SolveDeepAddress().
+
+Returns 0 if successful, or 1 if an error occured when reading/parsing the files.
+*/
+s32 RunDeepBatch(s32 id1, s32 id2, const char* queries_path, s32 depth, const char* mapping_3d_path, const char* starmap_path, const char* mapping_2d_path, s32 thread_count)
+{
+	if (depth < 1 || depth > MAX_DEEP_SUBDIVISION_COUNT)
+	{
+		printf("Depth %d is out of range, it needs to be between 1 and %d.\n", depth, MAX_DEEP_SUBDIVISION_COUNT);
+		return 1;
+	}
+
+	Ball ball = {};
+	if (!LoadBall(id1, id2, mapping_3d_path, starmap_path, mapping_2d_path, &ball)) return 1;
+
+	ThreadPool pool;
+	StartThreadPool(&pool, thread_count);
+	Vec3Batch queries;
+	if (!LoadQueries(queries_path, &queries, &pool))
+	{
+		StopThreadPool(&pool);
+		return 1;
+	}
+
+	s32 count = queries.count;
+	s32 (*addresses)[MAX_DEEP_ADDRESS_LENGTH] = (s32 (*)[MAX_DEEP_ADDRESS_LENGTH])malloc(count * sizeof(*addresses));
+
+	SolveDeepAddressesJob job;
+	job.ball = &ball;
+	job.desired = queries;
+	job.depth = depth;
+	job.out_addresses = addresses;
+	job.solved_count = 0;
+	RunParallel(&pool, count, SOLVE_CHUNK_SIZE, SolveDeepAddressesChunk, &job);
+	StopThreadPool(&pool);
+
+	OutputWriter output;
+	StartOutput(&output, stdout, output_format);
+	AddOutputColumn(&output, "Index");
+	for (s32 i = 0; i <= depth; ++i) AddOutputColumn(&output, "Symbol %d", i + 1);
+	WriteOutputHeader(&output);
+	for (s32 i = 0; i < count; ++i)
+	{
+		WriteOutputInt(&output, i);
+		for (s32 j = 0; j <= depth; ++j) WriteOutputInt(&output, addresses[i][j]);
+		EndOutputRow(&output);
+	}
+	FinishOutput(&output);
+
+	free(addresses);
+	queries.Free();
+	return 0;
+}
@@ -11,8 +11,10 @@ actually need the extra precision.
 This is more than a matter of just replacing all instances of "float" with
 "double", since we also have to strip the "f" off of any literals.
 
-What that means is that I have disabled the SSE intrinsics, and it will
-not compile if you re-enable them.
+That also meant the old SSE intrinsics didn't work anymore, since they were
+all packed single precision floats. They've been rewritten for doubles now,
+using SSE2 for the two wide stuff and AVX2 for the four wide stuff, so Vec4,
+Quat and Mat4 each fit in one register. See GMATH_USE_SSE below.
 
 You're welcome to use this library for other stuff, but you probably want to
 go find the un-hacked version, or ask me about it, or better yet just use the
@@ -47,12 +49,15 @@ in exactly one C++ file. You can then include this header file wherever needed.
 There are several options which alter the definitions provided by the library,
 and so require you comment or remove a line in this file:
 
-By default, the library will use SSE intrinsics for some operations if they are
-available, for a minor speed boost. If you would like to disable SSE intrinsics,
-you must comment or remove the following line:
+By default, the library will use SSE2 intrinsics for some operations if they are
+available, for a minor speed boost, and AVX2 intrinsics as well if the compiler
+is allowed to use them (/arch:AVX2 on MSVC, -mavx2 elsewhere). The SIMD versions
+do their adds in the same order as the scalar code, so they give exactly the same
+results. If you would like to disable SIMD intrinsics, you must comment or remove
+the following line:
 */
 
-// #define GMATH_USE_SSE
+#define GMATH_USE_SSE
 
 /*
 If you would like the library types and functions to be in the global namespace
@@ -161,21 +166,29 @@ normalize, etc.
 #endif
 
 #ifdef GMATH_USE_SSE
-#undef GMATH_USE_SSE // We will redefine this if SSE is supported.
+#undef GMATH_USE_SSE // We will redefine this if SSE2 is supported.
 #ifdef _MSC_VER
-// MSVC supports SSE in amd64 mode or _M_IX86_FP >= 1 (2 means SSE2).
-#if defined(_M_AMD64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 1 )
+// MSVC supports SSE2 in amd64 mode or _M_IX86_FP >= 2.
+#if defined(_M_AMD64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
 #define GMATH_USE_SSE 1
-#endif // _M_AMD64 OR _M_IX86_FP >= 1
-#else // If not MSVC, check if SSE is supported anyway.
-#ifdef __SSE__
+#endif // _M_AMD64 OR _M_IX86_FP >= 2
+#else // If not MSVC, check if SSE2 is supported anyway.
+#ifdef __SSE2__
 #define GMATH_USE_SSE 1
-#endif // __SSE__
+#endif // __SSE2__
 #endif // _MSC_VER
+// The four wide stuff needs AVX2 for shuffling across the whole register.
+// MSVC defines __AVX2__ too when building with /arch:AVX2 or higher.
+#if defined(GMATH_USE_SSE) && defined(__AVX2__)
+#define GMATH_USE_AVX 1
+#endif // __AVX2__
 #endif // GMATH_USE_SSE
 
 #ifdef GMATH_USE_SSE
-#include <xmmintrin.h>
+#include <emmintrin.h>
+#endif
+#ifdef GMATH_USE_AVX
+#include <immintrin.h>
 #endif
 
 #if !defined(GMATH_SIN) || !defined(GMATH_COS) || !defined(GMATH_TAN) || \
@@ -470,10 +483,8 @@ namespace GMath
 			struct {double ignored_r; Vec2 gb; double ignored_a;};
 			struct {double ignored_r; double ignored_g; Vec2 ba;};
             
-            // SSE type (four packed single precision floats).
-#ifdef GMATH_USE_SSE
-            __m128 sse;
-#endif
+            // There's no SIMD type in here on purpose, since a __m256d would make the
+            // type 32 byte aligned. The SIMD code loads from and stores to data instead.
         };
 		
 		inline Vec4() = default;
@@ -534,10 +545,6 @@ namespace GMath
         {
             Vec4 cols[4];
             double data[16];
-			
-#ifdef GMATH_USE_SSE
-            __m128 sse[4];
-#endif
         };
 		
 		inline Mat4() = default;
@@ -569,9 +576,6 @@ namespace GMath
             struct {union {Vec3 xyz; struct {double x, y, z;};}; double w;};
             double data[4];
 			//Vec4 vector;
-#ifdef GMATH_USE_SSE
-            __m128 sse;
-#endif
         };
 		
 		inline Quat() = default;
@@ -678,6 +682,23 @@ namespace GMath
 namespace GMath
 {
 #endif
+#ifdef GMATH_USE_AVX
+	// Helpers for moving things in and out of AVX registers. Vec3 goes in the low three lanes, and the
+	// last lane is zero. These are just unaligned loads and stores, which get optimized into register moves.
+	static inline __m256d LoadAVX(Vec3 v) {return _mm256_set_m128d(_mm_load_sd(&v.z), _mm_loadu_pd(&v.x));}
+	static inline __m256d LoadAVX(Vec4 v) {return _mm256_loadu_pd(v.data);}
+	static inline __m256d LoadAVX(Quat q) {return _mm256_loadu_pd(q.data);}
+	static inline Vec3 StoreVec3(__m256d r)
+	{
+		Vec3 v;
+		_mm_storeu_pd(&v.x, _mm256_castpd256_pd128(r));
+		_mm_store_sd(&v.z, _mm256_extractf128_pd(r, 1));
+		return v;
+	}
+	static inline Vec4 StoreVec4(__m256d r) {Vec4 v; _mm256_storeu_pd(v.data, r); return v;}
+	static inline Quat StoreQuat(__m256d r) {Quat q; _mm256_storeu_pd(q.data, r); return q;}
+#endif
+	
     // Math function definitions.
 	// TODO(Frog): These cause multiple include errors, move into header guard.
     double Sin(double radians) {return GMATH_SIN(radians);}
@@ -697,23 +718,18 @@ namespace GMath
     double Sqrt(double val)
     {
 #ifdef GMATH_USE_SSE
-        __m128 in = _mm_set_ss(val);
-        __m128 out = _mm_sqrt_ss(in);
-        return _mm_cvtss_f32(out);
+        __m128d in = _mm_set_sd(val);
+        __m128d out = _mm_sqrt_sd(in, in);
+        return _mm_cvtsd_f64(out);
 #else
         return GMATH_SQRT(val);
 #endif
     }
     
+    // There's no double precision approximate rsqrt before AVX-512, so this one is always exact.
     double RSqrt(double val)
     {
-#ifdef GMATH_USE_SSE
-        __m128 in = _mm_set_ss(val);
-        __m128 out = _mm_rsqrt_ss(in);
-        return _mm_cvtss_f32(out);
-#else
-        return 1.0 / GMATH_SQRT(val);
-#endif
+        return 1.0 / Sqrt(val);
     }
     
     double Radians(double degrees)
@@ -792,17 +808,35 @@ namespace GMath
     int Dot(IVec2 a, IVec2 b) {return a.x * b.x + a.y * b.y;}
     int Dot(IVec3 a, IVec3 b) {return a.x * b.x + a.y + b.y + a.z * b.z;}
     double Dot(Vec2 a, Vec2 b) {return a.x * b.x + a.y * b.y;}
-    double Dot(Vec3 a, Vec3 b) {return a.x * b.x + a.y * b.y + a.z * b.z;}
+#ifdef GMATH_USE_SSE
+    // Sums up four packed products (two if xy only) in the same order as the scalar code.
+    static inline double SumProducts(__m128d xy, __m128d zw)
+    {
+        __m128d sum = _mm_add_sd(xy, _mm_unpackhi_pd(xy, xy));
+        sum = _mm_add_sd(sum, zw);
+        sum = _mm_add_sd(sum, _mm_unpackhi_pd(zw, zw));
+        return _mm_cvtsd_f64(sum);
+    }
+#endif
+    
+    double Dot(Vec3 a, Vec3 b)
+    {
+#ifdef GMATH_USE_SSE
+        __m128d xy = _mm_mul_pd(_mm_loadu_pd(&a.x), _mm_loadu_pd(&b.x));
+        __m128d z = _mm_mul_sd(_mm_load_sd(&a.z), _mm_load_sd(&b.z));
+        return _mm_cvtsd_f64(_mm_add_sd(_mm_add_sd(xy, _mm_unpackhi_pd(xy, xy)), z));
+#else
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+#endif
+    }
+    
     double Dot(Vec4 a, Vec4 b)
     {
         double result;
 #ifdef GMATH_USE_SSE
-        __m128 result_one = _mm_mul_ps(a.sse, b.sse);
-        __m128 result_two = _mm_shuffle_ps(result_one, result_two, _MM_SHUFFLE(2, 3, 0, 1));
-        result_one = _mm_add_ps(result_one, result_two);
-        result_two = _mm_shuffle_ps(result_one, result_one, _MM_SHUFFLE(0, 1, 2, 3));
-        result_one = _mm_add_ps(result_one, result_two);
-        _mm_store_ss(&result, result_one);
+        __m128d xy = _mm_mul_pd(_mm_loadu_pd(&a.data[0]), _mm_loadu_pd(&b.data[0]));
+        __m128d zw = _mm_mul_pd(_mm_loadu_pd(&a.data[2]), _mm_loadu_pd(&b.data[2]));
+        result = SumProducts(xy, zw);
 #else
         result = (a.x * b.x) + (a.y * b.y) + (a.z * b.z) + (a.w * b.w);
 #endif
@@ -811,7 +845,17 @@ namespace GMath
     
     Vec3 Cross(Vec3 a, Vec3 b)
     {
+#ifdef GMATH_USE_AVX
+        __m256d va = LoadAVX(a);
+        __m256d vb = LoadAVX(b);
+        __m256d a_yzx = _mm256_permute4x64_pd(va, _MM_SHUFFLE(3, 0, 2, 1));
+        __m256d a_zxy = _mm256_permute4x64_pd(va, _MM_SHUFFLE(3, 1, 0, 2));
+        __m256d b_yzx = _mm256_permute4x64_pd(vb, _MM_SHUFFLE(3, 0, 2, 1));
+        __m256d b_zxy = _mm256_permute4x64_pd(vb, _MM_SHUFFLE(3, 1, 0, 2));
+        return StoreVec3(_mm256_sub_pd(_mm256_mul_pd(a_yzx, b_zxy), _mm256_mul_pd(a_zxy, b_yzx)));
+#else
         return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+#endif
     }
     
     int LengthSquared(IVec2 vec)
@@ -874,7 +918,16 @@ namespace GMath
     Vec3 Normalize(Vec3 vec)
     {
         double length = Length(vec);
-        return (length == 0.0) ? Vec3::Zero : vec / length;
+        if (length == 0.0) return Vec3::Zero;
+#ifdef GMATH_USE_SSE
+        Vec3 result;
+        __m128d l = _mm_set1_pd(length);
+        _mm_storeu_pd(&result.x, _mm_div_pd(_mm_loadu_pd(&vec.x), l));
+        _mm_store_sd(&result.z, _mm_div_sd(_mm_load_sd(&vec.z), l));
+        return result;
+#else
+        return vec / length;
+#endif
     }
     
     Vec3 FastNormalize(Vec3 vec)
@@ -931,18 +984,14 @@ namespace GMath
     
     Mat4 Transpose(Mat4 mat)
     {
-#ifdef GMATH_USE_SSE
-        _MM_TRANSPOSE4_PS(mat.sse[0], mat.sse[1], mat.sse[2], mat.sse[3]);
-#else
         Vec4 row1 = {mat.cols[0].x, mat.cols[1].x, mat.cols[2].x, mat.cols[3].x};
         Vec4 row2 = {mat.cols[0].y, mat.cols[1].y, mat.cols[2].y, mat.cols[3].y};
         Vec4 row3 = {mat.cols[0].z, mat.cols[1].z, mat.cols[2].z, mat.cols[3].z};
         Vec4 row4 = {mat.cols[0].w, mat.cols[1].w, mat.cols[2].w, mat.cols[3].w};
         mat[0] = row1;
         mat[1] = row2;
-        mat[3] = row3;
-        mat[4] = row4;
-#endif
+        mat[2] = row3;
+        mat[3] = row4;
         return mat;
     }
     
@@ -1054,12 +1103,9 @@ namespace GMath
     {
         double result;
 #ifdef GMATH_USE_SSE
-        __m128 result_one = _mm_mul_ps(a.sse, b.sse);
-        __m128 result_two = _mm_shuffle_ps(result_one, result_one, _MM_SHUFFLE(2, 3, 0, 1));
-        result_one = _mm_add_ps(result_one, result_two);
-        result_two = _mm_shuffle_ps(result_one, result_one, _MM_SHUFFLE(0, 1, 2, 3));
-        result_one = _mm_add_ps(result_one, result_two);
-        _mm_store_ss(&result, result_one);
+        __m128d xy = _mm_mul_pd(_mm_loadu_pd(&a.data[0]), _mm_loadu_pd(&b.data[0]));
+        __m128d zw = _mm_mul_pd(_mm_loadu_pd(&a.data[2]), _mm_loadu_pd(&b.data[2]));
+        result = SumProducts(xy, zw);
 #else
         result = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
 #endif
@@ -1077,13 +1123,13 @@ namespace GMath
     Quat Lerp(Quat a, Quat b, double alpha)
     {
         Quat result;
-#ifdef GMATH_USE_SSE
+#ifdef GMATH_USE_AVX
         double clamped_alpha = Clamp(alpha, 0.0, 1.0);
-        __m128 a_scalar = _mm_set1_ps(1.0 - clamped_alpha);
-        __m128 b_scalar = _mm_set1_ps(clamped_alpha);
-        __m128 result_one = _mm_mul_ps(a.sse, a_scalar);
-        __m128 result_two = _mm_mul_ps(b.sse, b_scalar);
-        result.sse = _mm_add_ps(result_one, result_two);
+        __m256d a_scalar = _mm256_set1_pd(1.0 - clamped_alpha);
+        __m256d b_scalar = _mm256_set1_pd(clamped_alpha);
+        __m256d result_one = _mm256_mul_pd(LoadAVX(a), a_scalar);
+        __m256d result_two = _mm256_mul_pd(LoadAVX(b), b_scalar);
+        result = StoreQuat(_mm256_add_pd(result_one, result_two));
 #else
         result.x = Lerp(a.x, b.x, alpha);
         result.y = Lerp(a.y, b.y, alpha);
@@ -1274,35 +1320,6 @@ namespace GMath
 	// Vec4 Implementation
 	// ============================================================================
 	
-#ifdef GMATH_USE_SSE
-	Vec4::Vec4(double fill) : sse(_mm_set1_ps(fill)) {}
-	Vec4::Vec4(Vec3 xyz, double w) : sse(_mm_setr_ps(xyz.x, xyz.y, xyz.z, w)) {}
-	Vec4::Vec4(double x, Vec3 yzw) : sse(_mm_setr_ps(x, yzw.x, yzw.y, yzw.z)) {}
-	Vec4::Vec4(Vec2 xy, Vec2 zw) : sse(_mm_setr_ps(xy.x, xy.y, zw.x, zw.y)) {}
-	Vec4::Vec4(Vec2 xy, double z, double w) : sse(_mm_setr_ps(xy.x, xy.y, z, w)) {}
-	Vec4::Vec4(double x, Vec2 yz, double w) : sse(_mm_setr_ps(x, yz.x, yz.y, w)) {}
-	Vec4::Vec4(double x, double y, Vec2 zw) : sse(_mm_setr_ps(x, y, zw.x, zw.y)) {}
-	Vec4::Vec4(double x, double y, double z, double w) : sse(_mm_setr_ps(x, y, z, w)) {}
-	Vec4::Vec4(double data[4]) : sse(_mm_setr_ps(data[0], data[1], data[2], data[3])) {}
-	Vec4::Vec4(Quat quat) : sse(quat.sse) {}
-	
-	Vec4& Vec4::operator+=(Vec4 o) {sse = _mm_add_ps(sse, o.sse);return *this;}
-	Vec4& Vec4::operator-=(Vec4 o) {sse = _mm_sub_ps(sse, o.sse);return *this;}
-	Vec4& Vec4::operator*=(Vec4 o) {sse = _mm_mul_ps(sse, o.sse);return *this;}
-	Vec4& Vec4::operator*=(double o) {__m128 c = _mm_set1_ps(o);sse = _mm_mul_ps(sse, c);return *this;}
-	Vec4& Vec4::operator/=(Vec4 o) {sse = _mm_div_ps(sse, o.sse);return *this;}
-	Vec4& Vec4::operator/=(double o) {__m128 c = _mm_set1_ps(o);sse = _mm_div_ps(sse, c);return *this;}
-	
-	Vec4 operator*(Vec4 a, Vec4 b) {Vec4 o;o.sse = _mm_mul_ps(a.sse, b.sse);return o;}
-	Vec4 operator*(Vec4 a, double b) {Vec4 o;__m128 c = _mm_set1_ps(b);o.sse = _mm_mul_ps(a.sse, c);return o;}
-	Vec4 operator*(double a, Vec4 b) {Vec4 o;__m128 c = _mm_set1_ps(a);o.sse = _mm_mul_ps(c, b.sse);return o;}
-	Vec4 operator/(Vec4 a, Vec4 b) {Vec4 o;o.sse = _mm_div_ps(a.sse, b.sse);return o;}
-	Vec4 operator/(Vec4 a, double b) {Vec4 o;__m128 c = _mm_set1_ps(b);o.sse = _mm_div_ps(a.sse, c);return o;}
-	Vec4 operator/(double a, Vec4 b) {Vec4 o;__m128 c = _mm_set1_ps(a);o.sse = _mm_div_ps(c, b.sse);return o;}
-	Vec4 operator+(Vec4 a, Vec4 b) {Vec4 o;o.sse = _mm_add_ps(a.sse, b.sse);return o;}
-	Vec4 operator-(Vec4 a, Vec4 b) {Vec4 o;o.sse = _mm_sub_ps(a.sse, b.sse);return o;}
-	Vec4 operator-(Vec4 a) {Vec4 o;__m128 c = _mm_set1_ps(-1);o.sse = _mm_mul_ps(a.sse, c);return o;}
-#else
 	Vec4::Vec4(double fill) : x(fill), y(fill), z(fill), w(fill) {}
 	Vec4::Vec4(Vec3 xyz, double w) : xyz(xyz), w(w) {}
 	Vec4::Vec4(double x, Vec3 yzw) : x(x), yzw(yzw) {}
@@ -1314,10 +1331,30 @@ namespace GMath
 	Vec4::Vec4(double data[4]) : data{data[0], data[1], data[2], data[3]} {}
 	Vec4::Vec4(Quat quat) : x(quat.x), y(quat.y), z(quat.z), w(quat.w) {}
 	
+#ifdef GMATH_USE_AVX
+	Vec4& Vec4::operator+=(Vec4 o) {*this = StoreVec4(_mm256_add_pd(LoadAVX(*this), LoadAVX(o)));return *this;}
+	Vec4& Vec4::operator-=(Vec4 o) {*this = StoreVec4(_mm256_sub_pd(LoadAVX(*this), LoadAVX(o)));return *this;}
+	Vec4& Vec4::operator*=(Vec4 o) {*this = StoreVec4(_mm256_mul_pd(LoadAVX(*this), LoadAVX(o)));return *this;}
+	Vec4& Vec4::operator*=(double o) {*this = StoreVec4(_mm256_mul_pd(LoadAVX(*this), _mm256_set1_pd(o)));return *this;}
+	Vec4& Vec4::operator/=(Vec4 o) {*this = StoreVec4(_mm256_div_pd(LoadAVX(*this), LoadAVX(o)));return *this;}
+	Vec4& Vec4::operator/=(double o) {*this = StoreVec4(_mm256_div_pd(LoadAVX(*this), _mm256_set1_pd(o)));return *this;}
+	
+	Vec4 operator*(Vec4 a, Vec4 b) {return StoreVec4(_mm256_mul_pd(LoadAVX(a), LoadAVX(b)));}
+	Vec4 operator*(Vec4 a, double b) {return StoreVec4(_mm256_mul_pd(LoadAVX(a), _mm256_set1_pd(b)));}
+	Vec4 operator*(double a, Vec4 b) {return StoreVec4(_mm256_mul_pd(_mm256_set1_pd(a), LoadAVX(b)));}
+	Vec4 operator/(Vec4 a, Vec4 b) {return StoreVec4(_mm256_div_pd(LoadAVX(a), LoadAVX(b)));}
+	Vec4 operator/(Vec4 a, double b) {return StoreVec4(_mm256_div_pd(LoadAVX(a), _mm256_set1_pd(b)));}
+	Vec4 operator/(double a, Vec4 b) {return StoreVec4(_mm256_div_pd(_mm256_set1_pd(a), LoadAVX(b)));}
+	Vec4 operator+(Vec4 a, Vec4 b) {return StoreVec4(_mm256_add_pd(LoadAVX(a), LoadAVX(b)));}
+	Vec4 operator-(Vec4 a, Vec4 b) {return StoreVec4(_mm256_sub_pd(LoadAVX(a), LoadAVX(b)));}
+	Vec4 operator-(Vec4 a) {return StoreVec4(_mm256_xor_pd(LoadAVX(a), _mm256_set1_pd(-0.0)));}
+#else
 	Vec4& Vec4::operator+=(Vec4 o) {x += o.x;y += o.y;z += o.z;w += o.w;return *this;}
 	Vec4& Vec4::operator-=(Vec4 o) {x -= o.x;y -= o.y;z -= o.z;w -= o.w;return *this;}
 	Vec4& Vec4::operator*=(Vec4 o) {x *= o.x;y *= o.y;z *= o.z;w *= o.w;return *this;}
+	Vec4& Vec4::operator*=(double o) {x *= o;y *= o;z *= o;w *= o;return *this;}
 	Vec4& Vec4::operator/=(Vec4 o) {x /= o.x;y /= o.y;z /= o.z;w /= o.w;return *this;}
+	Vec4& Vec4::operator/=(double o) {x /= o;y /= o;z /= o;w /= o;return *this;}
 	
 	Vec4 operator*(Vec4 a, Vec4 b) {return {a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w};}
     Vec4 operator*(Vec4 a, double b) {return {a.x * b, a.y * b, a.z * b, a.w * b};}
@@ -1387,32 +1424,27 @@ namespace GMath
 	
 	Mat4 operator+(Mat4 a, Mat4 b) {return {a[0] + b[0], a[1] + b[1], a[2] + b[2], a[3] + b[3]};}
 	Mat4 operator-(Mat4 a, Mat4 b) {return {a[0] - b[0], a[1] - b[1], a[2] - b[2], a[3] - b[3]};}
-#ifdef GMATH_USE_SSE
-	static  __m128 LinearCombineSSE(__m128 left, Mat4 right)
+#ifdef GMATH_USE_AVX
+	// Computes a[0] * b.x + a[1] * b.y + a[2] * b.z + a[3] * b.w, adding in the same order as the scalar version.
+	static inline __m256d LinearCombineAVX(Mat4 a, Vec4 b)
 	{
-		__m128 result;
-		result = _mm_mul_ps(_mm_shuffle_ps(left, left, 0x00), right.sse[0]);
-		result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(left, left, 0x55), right.sse[1]));
-		result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(left, left, 0xaa), right.sse[2]));
-		result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(left, left, 0xff), right.sse[3]));
+		__m256d result = _mm256_mul_pd(LoadAVX(a[0]), _mm256_set1_pd(b.x));
+		result = _mm256_add_pd(result, _mm256_mul_pd(LoadAVX(a[1]), _mm256_set1_pd(b.y)));
+		result = _mm256_add_pd(result, _mm256_mul_pd(LoadAVX(a[2]), _mm256_set1_pd(b.z)));
+		result = _mm256_add_pd(result, _mm256_mul_pd(LoadAVX(a[3]), _mm256_set1_pd(b.w)));
 		return result;
 	}
 	
 	Mat4 operator*(Mat4 a, Mat4 b)
 	{
 		Mat4 result;
-		result.sse[0] = LinearCombineSSE(b.sse[0], a);
-		result.sse[1] = LinearCombineSSE(b.sse[1], a);
-		result.sse[2] = LinearCombineSSE(b.sse[2], a);
-		result.sse[3] = LinearCombineSSE(b.sse[3], a);
+		for (int i = 0; i < 4; ++i) result[i] = StoreVec4(LinearCombineAVX(a, b[i]));
 		return result;
 	}
 	
 	Vec4 operator*(Mat4 a, Vec4 b)
 	{
-		Vec4 result;
-		result.sse = LinearCombineSSE(b.sse, a);
-		return result;
+		return StoreVec4(LinearCombineAVX(a, b));
 	}
 #else
 	Mat4 operator*(Mat4 a, Mat4 b)
@@ -1445,39 +1477,28 @@ namespace GMath
 	// Quat Implementation
 	// ============================================================================
 	
-#ifdef GMATH_USE_SSE
-	Quat::Quat(double fill) : sse(_mm_setr_ps(fill, fill, fill, fill)) {}
-	Quat::Quat(double x, double y, double z, double w) : sse(_mm_setr_ps(x, y, z, w)) {}
-	Quat::Quat(Vec4 values) : sse(values.sse) {}
-	Quat::Quat(double data[4]) : sse(_mm_setr_ps(data[0], data[1], data[2], data[3])) {}
+	Quat::Quat(double fill) : x(fill), y(fill), z(fill), w(fill) {}
+	Quat::Quat(double x, double y, double z, double w) : x(x), y(y), z(z), w(w) {}
+	Quat::Quat(Vec4 values) : x(values.x), y(values.y), z(values.z), w(values.w) {}
+	Quat::Quat(double data[4]) : data{data[0], data[1], data[2], data[3]} {}
 	
+#ifdef GMATH_USE_AVX
+	// Each component of a gets multiplied by a shuffled and sign flipped b, and then they're all added up
+	// in the same order as the scalar version below.
 	Quat operator*(Quat a, Quat b)
     {
-        Quat result;
-        __m128 result_one = _mm_xor_ps(_mm_shuffle_ps(a.sse, a.sse, _MM_SHUFFLE(0, 0, 0, 0)), _mm_setr_ps(0.0, -0.0, 0.0, -0.0));
-        __m128 result_two = _mm_shuffle_ps(b.sse, b.sse, _MM_SHUFFLE(0, 1, 2, 3));
-        __m128 result_three = _mm_mul_ps(result_two, result_one);
-        
-        result_one = _mm_xor_ps(_mm_shuffle_ps(a.sse, a.sse, _MM_SHUFFLE(1, 1, 1, 1)) , _mm_setr_ps(0.0, 0.0, -0.0, -0.0));
-        result_two = _mm_shuffle_ps(b.sse, b.sse, _MM_SHUFFLE(1, 0, 3, 2));
-        result_three = _mm_add_ps(result_three, _mm_mul_ps(result_two, result_one));
-        
-        result_one = _mm_xor_ps(_mm_shuffle_ps(a.sse, a.sse, _MM_SHUFFLE(2, 2, 2, 2)), _mm_setr_ps(-0.0, 0.0, 0.0, -0.0));
-        result_two = _mm_shuffle_ps(b.sse, b.sse, _MM_SHUFFLE(2, 3, 0, 1));
-        result_three = _mm_add_ps(result_three, _mm_mul_ps(result_two, result_one));
-        
-        result_one = _mm_shuffle_ps(a.sse, a.sse, _MM_SHUFFLE(3, 3, 3, 3));
-        result_two = _mm_shuffle_ps(b.sse, b.sse, _MM_SHUFFLE(3, 2, 1, 0));
-        result.sse = _mm_add_ps(result_three, _mm_mul_ps(result_two, result_one));
-        return result;
+        __m256d vb = LoadAVX(b);
+        __m256d result = _mm256_mul_pd(_mm256_xor_pd(_mm256_set1_pd(a.x), _mm256_setr_pd(0.0, -0.0, 0.0, -0.0)),
+                                       _mm256_permute4x64_pd(vb, _MM_SHUFFLE(0, 1, 2, 3)));
+        result = _mm256_add_pd(result, _mm256_mul_pd(_mm256_xor_pd(_mm256_set1_pd(a.y), _mm256_setr_pd(0.0, 0.0, -0.0, -0.0)),
+                                                     _mm256_permute4x64_pd(vb, _MM_SHUFFLE(1, 0, 3, 2))));
+        result = _mm256_add_pd(result, _mm256_mul_pd(_mm256_xor_pd(_mm256_set1_pd(a.z), _mm256_setr_pd(-0.0, 0.0, 0.0, -0.0)),
+                                                     _mm256_permute_pd(vb, 0x5)));
+        result = _mm256_add_pd(result, _mm256_mul_pd(_mm256_set1_pd(a.w), vb));
+        return StoreQuat(result);
     }
     
 #else
-	Quat::Quat(double fill) : x(fill), y(fill), z(fill), w(fill) {}
-	Quat::Quat(double x, double y, double z, double w) : x(x), y(y), z(z), w(w) {}
-	Quat::Quat(Vec4 values) : x(values.x), y(values.y), z(values.z), w(values.w) {}
-	Quat::Quat(double data[4]) : data{data[0], data[1], data[2], data[3]} {}
-	
 	Quat operator*(Quat a, Quat b)
     {
         Quat result;
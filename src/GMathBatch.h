@@ -0,0 +1,378 @@
+#ifndef _GMATH_BATCH_H
+#define _GMATH_BATCH_H
+
+/*
+Batch versions of the GMath types, for when we want to do the same math to a big pile of vectors.
+
+Vec3Batch, QuatBatch and DoubleBatch store each component in its own array (structure of arrays),
+and they're just views, so copying one around doesn't copy the data. Use Allocate() and Free() to
+manage the memory, and Slice() to get a view of part of a batch (which must not be freed).
+
+The operators don't compute anything by themselves. They build up an expression, and nothing happens
+until you Assign() the expression to a batch, which does the whole thing in one loop over the elements.
+So something like this:
+
+out.Assign(Normalize(Cross(a, b)) * 2.0);
+
+is a single loop that reads a and b and writes out, with no temporary batches in between, and the
+compiler is free to vectorize it. Anywhere you can use a batch in an expression, you can also use a
+single value, which gets used for every element.
+
+Every batch in an expression needs at least as many elements as the batch you're assigning to.
+Assigning to a batch that is also read by the expression is fine, since each element only ever
+reads from the same index.
+
+The per element math is written out here instead of calling the GMath functions, so that it stays
+plain scalar code the compiler can vectorize across elements. It does the same operations in the
+same order as GMath though, so you get exactly the same results as the single value versions.
+MSVC is happy to vectorize all of it, but GCC and Clang need -fno-math-errno and -fno-trapping-math
+before they'll vectorize anything with a square root or a Normalize() in it.
+*/
+
+#include "GMath.h"
+
+// Tells the compiler the loop iterations don't depend on each other, so it doesn't need to check for aliasing.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define GMATH_BATCH_IVDEP __pragma(loop(ivdep))
+#elif defined(__clang__)
+#define GMATH_BATCH_IVDEP _Pragma("clang loop vectorize(assume_safety)")
+#elif defined(__GNUC__)
+#define GMATH_BATCH_IVDEP _Pragma("GCC ivdep")
+#else
+#define GMATH_BATCH_IVDEP
+#endif
+
+#ifdef GMATH_USE_NAMESPACE
+namespace GMath
+{
+#endif
+	// Base for everything that can go in a batch expression. T is the per element type (double, Vec3 or Quat),
+	// and E is the actual expression type, which must have a "T Eval(int i) const" function.
+	template <typename T, typename E>
+	struct BatchExpr
+	{
+		inline const E& Self() const {return static_cast<const E&>(*this);}
+	};
+
+	// A single value used for every element.
+	template <typename T>
+	struct BatchConstant : BatchExpr<T, BatchConstant<T>>
+	{
+		T value;
+		inline BatchConstant(T value) : value(value) {}
+		inline T Eval(int) const {return value;}
+	};
+
+	template <typename T, typename Op, typename A>
+	struct BatchUnary : BatchExpr<T, BatchUnary<T, Op, A>>
+	{
+		A a;
+		inline BatchUnary(const A& a) : a(a) {}
+		inline T Eval(int i) const {return Op::Apply(a.Eval(i));}
+	};
+
+	template <typename T, typename Op, typename A, typename B>
+	struct BatchBinary : BatchExpr<T, BatchBinary<T, Op, A, B>>
+	{
+		A a;
+		B b;
+		inline BatchBinary(const A& a, const B& b) : a(a), b(b) {}
+		inline T Eval(int i) const {return Op::Apply(a.Eval(i), b.Eval(i));}
+	};
+
+	struct DoubleBatch : BatchExpr<double, DoubleBatch>
+	{
+		int count;
+		double* data;
+
+		static inline DoubleBatch Allocate(int count)
+		{
+			DoubleBatch result;
+			result.count = count;
+			result.data = (double*)malloc(count * sizeof(double));
+			return result;
+		}
+		inline void Resize(int new_count)
+		{
+			count = new_count;
+			data = (double*)realloc(data, count * sizeof(double));
+		}
+		inline void Free() {free(data); data = nullptr; count = 0;}
+
+		inline double Eval(int i) const {return data[i];}
+		inline double operator[](int i) const {return data[i];}
+		inline void Set(int i, double v) {data[i] = v;}
+		inline DoubleBatch Slice(int begin, int slice_count) const
+		{
+			DoubleBatch result;
+			result.count = slice_count;
+			result.data = data + begin;
+			return result;
+		}
+
+		template <typename E>
+		inline void Assign(const BatchExpr<double, E>& expr)
+		{
+			const E& e = expr.Self();
+			GMATH_BATCH_IVDEP
+			for (int i = 0; i < count; ++i) data[i] = e.Eval(i);
+		}
+	};
+
+	struct Vec3Batch : BatchExpr<Vec3, Vec3Batch>
+	{
+		int count;
+		double* x;
+		double* y;
+		double* z;
+
+		static inline Vec3Batch Allocate(int count)
+		{
+			Vec3Batch result;
+			result.count = count;
+			result.x = (double*)malloc(count * sizeof(double));
+			result.y = (double*)malloc(count * sizeof(double));
+			result.z = (double*)malloc(count * sizeof(double));
+			return result;
+		}
+		inline void Resize(int new_count)
+		{
+			count = new_count;
+			x = (double*)realloc(x, count * sizeof(double));
+			y = (double*)realloc(y, count * sizeof(double));
+			z = (double*)realloc(z, count * sizeof(double));
+		}
+		inline void Free() {free(x); free(y); free(z); x = y = z = nullptr; count = 0;}
+
+		inline Vec3 Eval(int i) const {return Vec3(x[i], y[i], z[i]);}
+		inline Vec3 operator[](int i) const {return Vec3(x[i], y[i], z[i]);}
+		inline void Set(int i, Vec3 v) {x[i] = v.x; y[i] = v.y; z[i] = v.z;}
+		inline Vec3Batch Slice(int begin, int slice_count) const
+		{
+			Vec3Batch result;
+			result.count = slice_count;
+			result.x = x + begin;
+			result.y = y + begin;
+			result.z = z + begin;
+			return result;
+		}
+
+		template <typename E>
+		inline void Assign(const BatchExpr<Vec3, E>& expr)
+		{
+			const E& e = expr.Self();
+			GMATH_BATCH_IVDEP
+			for (int i = 0; i < count; ++i)
+			{
+				Vec3 v = e.Eval(i);
+				x[i] = v.x;
+				y[i] = v.y;
+				z[i] = v.z;
+			}
+		}
+	};
+
+	struct QuatBatch : BatchExpr<Quat, QuatBatch>
+	{
+		int count;
+		double* x;
+		double* y;
+		double* z;
+		double* w;
+
+		static inline QuatBatch Allocate(int count)
+		{
+			QuatBatch result;
+			result.count = count;
+			result.x = (double*)malloc(count * sizeof(double));
+			result.y = (double*)malloc(count * sizeof(double));
+			result.z = (double*)malloc(count * sizeof(double));
+			result.w = (double*)malloc(count * sizeof(double));
+			return result;
+		}
+		inline void Resize(int new_count)
+		{
+			count = new_count;
+			x = (double*)realloc(x, count * sizeof(double));
+			y = (double*)realloc(y, count * sizeof(double));
+			z = (double*)realloc(z, count * sizeof(double));
+			w = (double*)realloc(w, count * sizeof(double));
+		}
+		inline void Free() {free(x); free(y); free(z); free(w); x = y = z = w = nullptr; count = 0;}
+
+		inline Quat Eval(int i) const {return Quat(x[i], y[i], z[i], w[i]);}
+		inline Quat operator[](int i) const {return Quat(x[i], y[i], z[i], w[i]);}
+		inline void Set(int i, Quat q) {x[i] = q.x; y[i] = q.y; z[i] = q.z; w[i] = q.w;}
+		inline QuatBatch Slice(int begin, int slice_count) const
+		{
+			QuatBatch result;
+			result.count = slice_count;
+			result.x = x + begin;
+			result.y = y + begin;
+			result.z = z + begin;
+			result.w = w + begin;
+			return result;
+		}
+
+		template <typename E>
+		inline void Assign(const BatchExpr<Quat, E>& expr)
+		{
+			const E& e = expr.Self();
+			GMATH_BATCH_IVDEP
+			for (int i = 0; i < count; ++i)
+			{
+				Quat q = e.Eval(i);
+				x[i] = q.x;
+				y[i] = q.y;
+				z[i] = q.z;
+				w[i] = q.w;
+			}
+		}
+	};
+
+	// Per element operations.
+	// ============================================================================
+
+	struct BatchAdd
+	{
+		static inline double Apply(double a, double b) {return a + b;}
+		static inline Vec3 Apply(Vec3 a, Vec3 b) {return Vec3(a.x + b.x, a.y + b.y, a.z + b.z);}
+	};
+
+	struct BatchSub
+	{
+		static inline double Apply(double a, double b) {return a - b;}
+		static inline Vec3 Apply(Vec3 a, Vec3 b) {return Vec3(a.x - b.x, a.y - b.y, a.z - b.z);}
+	};
+
+	struct BatchMul
+	{
+		static inline double Apply(double a, double b) {return a * b;}
+		static inline Vec3 Apply(Vec3 a, Vec3 b) {return Vec3(a.x * b.x, a.y * b.y, a.z * b.z);}
+		static inline Vec3 Apply(Vec3 a, double b) {return Vec3(a.x * b, a.y * b, a.z * b);}
+		static inline Vec3 Apply(double a, Vec3 b) {return Vec3(a * b.x, a * b.y, a * b.z);}
+		static inline Quat Apply(Quat a, Quat b)
+		{
+			return Quat((a.x * b.w) + (a.y * b.z) - (a.z * b.y) + (a.w * b.x),
+						(-a.x * b.z) + (a.y * b.w) + (a.z * b.x) + (a.w * b.y),
+						(a.x * b.y) - (a.y * b.x) + (a.z * b.w) + (a.w * b.z),
+						(-a.x * b.x) - (a.y * b.y) - (a.z * b.z) + (a.w * b.w));
+		}
+	};
+
+	struct BatchDiv
+	{
+		static inline double Apply(double a, double b) {return a / b;}
+		static inline Vec3 Apply(Vec3 a, double b) {return Vec3(a.x / b, a.y / b, a.z / b);}
+	};
+
+	struct BatchNegate
+	{
+		static inline double Apply(double a) {return -a;}
+		static inline Vec3 Apply(Vec3 a) {return Vec3(-a.x, -a.y, -a.z);}
+	};
+
+	struct BatchDot
+	{
+		static inline double Apply(Vec3 a, Vec3 b) {return a.x * b.x + a.y * b.y + a.z * b.z;}
+	};
+
+	struct BatchCross
+	{
+		static inline Vec3 Apply(Vec3 a, Vec3 b) {return Vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);}
+	};
+
+	struct BatchSqrt
+	{
+		static inline double Apply(double a) {return GMATH_SQRT(a);}
+	};
+
+	struct BatchLength
+	{
+		static inline double Apply(Vec3 a) {return GMATH_SQRT(a.x * a.x + a.y * a.y + a.z * a.z);}
+	};
+
+	// Same as Normalize() in GMath, a zero vector stays zero instead of dividing by zero.
+	// The divide always happens and then gets thrown away, so that the compiler can use a select instead of a branch.
+	struct BatchNormalize
+	{
+		static inline Vec3 Apply(Vec3 a)
+		{
+			double length = GMATH_SQRT(a.x * a.x + a.y * a.y + a.z * a.z);
+			double x = a.x / length, y = a.y / length, z = a.z / length;
+			bool zero = (length == 0.0);
+			return Vec3(zero ? 0.0 : x, zero ? 0.0 : y, zero ? 0.0 : z);
+		}
+		static inline Quat Apply(Quat a)
+		{
+			double length = GMATH_SQRT(a.x * a.x + a.y * a.y + a.z * a.z + a.w * a.w);
+			double x = a.x / length, y = a.y / length, z = a.z / length, w = a.w / length;
+			bool zero = (length == 0.0);
+			return Quat(zero ? 0.0 : x, zero ? 0.0 : y, zero ? 0.0 : z, zero ? 0.0 : w);
+		}
+	};
+
+	// Rotates a vector by a unit quaternion. This uses the two cross product version instead of multiplying by
+	// the quaternion and its inverse, so the results can be a tiny bit different from q * v * Invert(q).
+	struct BatchRotate
+	{
+		static inline Vec3 Apply(Quat q, Vec3 v)
+		{
+			Vec3 u = Vec3(q.x, q.y, q.z);
+			Vec3 t = BatchCross::Apply(u, v);
+			t = Vec3(t.x * 2.0, t.y * 2.0, t.z * 2.0);
+			Vec3 c = BatchCross::Apply(u, t);
+			return Vec3(v.x + q.w * t.x + c.x, v.y + q.w * t.y + c.y, v.z + q.w * t.z + c.z);
+		}
+	};
+
+	// Operators and functions.
+	// ============================================================================
+
+	// Defines a function for two expressions, plus versions where either side is a single value.
+#define GMATH_BATCH_BINARY(name, Op, TA, TB, TR) \
+	template <typename A, typename B> \
+	inline BatchBinary<TR, Op, A, B> name(const BatchExpr<TA, A>& a, const BatchExpr<TB, B>& b) \
+	{return BatchBinary<TR, Op, A, B>(a.Self(), b.Self());} \
+	template <typename A> \
+	inline BatchBinary<TR, Op, A, BatchConstant<TB>> name(const BatchExpr<TA, A>& a, TB b) \
+	{return BatchBinary<TR, Op, A, BatchConstant<TB>>(a.Self(), BatchConstant<TB>(b));} \
+	template <typename B> \
+	inline BatchBinary<TR, Op, BatchConstant<TA>, B> name(TA a, const BatchExpr<TB, B>& b) \
+	{return BatchBinary<TR, Op, BatchConstant<TA>, B>(BatchConstant<TA>(a), b.Self());}
+
+#define GMATH_BATCH_UNARY(name, Op, TA, TR) \
+	template <typename A> \
+	inline BatchUnary<TR, Op, A> name(const BatchExpr<TA, A>& a) {return BatchUnary<TR, Op, A>(a.Self());}
+
+	GMATH_BATCH_BINARY(operator+, BatchAdd, double, double, double)
+	GMATH_BATCH_BINARY(operator-, BatchSub, double, double, double)
+	GMATH_BATCH_BINARY(operator*, BatchMul, double, double, double)
+	GMATH_BATCH_BINARY(operator/, BatchDiv, double, double, double)
+	GMATH_BATCH_UNARY(operator-, BatchNegate, double, double)
+	GMATH_BATCH_UNARY(Sqrt, BatchSqrt, double, double)
+
+	GMATH_BATCH_BINARY(operator+, BatchAdd, Vec3, Vec3, Vec3)
+	GMATH_BATCH_BINARY(operator-, BatchSub, Vec3, Vec3, Vec3)
+	GMATH_BATCH_BINARY(operator*, BatchMul, Vec3, Vec3, Vec3)
+	GMATH_BATCH_BINARY(operator*, BatchMul, Vec3, double, Vec3)
+	GMATH_BATCH_BINARY(operator*, BatchMul, double, Vec3, Vec3)
+	GMATH_BATCH_BINARY(operator/, BatchDiv, Vec3, double, Vec3)
+	GMATH_BATCH_UNARY(operator-, BatchNegate, Vec3, Vec3)
+	GMATH_BATCH_BINARY(Dot, BatchDot, Vec3, Vec3, double)
+	GMATH_BATCH_BINARY(Cross, BatchCross, Vec3, Vec3, Vec3)
+	GMATH_BATCH_UNARY(Length, BatchLength, Vec3, double)
+	GMATH_BATCH_UNARY(Normalize, BatchNormalize, Vec3, Vec3)
+
+	GMATH_BATCH_BINARY(operator*, BatchMul, Quat, Quat, Quat)
+	GMATH_BATCH_UNARY(Normalize, BatchNormalize, Quat, Quat)
+	GMATH_BATCH_BINARY(Rotate, BatchRotate, Quat, Vec3, Vec3)
+
+#undef GMATH_BATCH_BINARY
+#undef GMATH_BATCH_UNARY
+
+#ifdef GMATH_USE_NAMESPACE
+};
+#endif
+
+#endif // _GMATH_BATCH_H
@@ -13,38 +13,133 @@ struct Burb
 };
 
 /*
-Computes the puzzle solution. I'm sure there is a fancy way to do this with a single matrix multiply or something,
-but this just manually figures out two basis vectors, finds the square size in each axis, and then offsets from the
-top left by the desired number of squares.
+Computes the puzzle solution. This used to work out two normalized basis vectors and the square size along each of them,
+but the normalizing and the square size cancel out, since a square is just an edge divided by the grid size. So it's
+an affine map: start at the top left, and move along each edge by the desired number of squares (offsetting by half a square).
 */
 Vec3 Burb::Interburbulate()
 {
-	// Normalized basis vectors.
-	Vec3 x_axis = Normalize(top_right - top_left);
-	Vec3 y_axis = Normalize(bottom_left - top_left);
+	Vec3 x_step = (top_right - top_left) * ((desired.x - 0.5) / (double)grid_size);
+	Vec3 y_step = (bottom_left - top_left) * ((desired.y - 0.5) / (double)grid_size);
+	return top_left + x_step + y_step;
+}
 
-	// Grid square size in each axis.
-	Vec2 square_size = Vec2(Length(top_right - top_left), Length(bottom_left - top_left)) / (double)grid_size;
+/*
+A chunk of a file of interburbul puzzles, with each input stored as a batch so they can all be solved in one go.
+Desired X/Y and the grid size are stored as doubles, since that's how Interburbulate() uses them anyway.
+*/
+struct BurbBatch
+{
+	s32 count;
+	DoubleBatch grid_size;
+	DoubleBatch desired_x;
+	DoubleBatch desired_y;
+	Vec3Batch top_left;
+	Vec3Batch top_right;
+	Vec3Batch bottom_left;
+};
 
-	// Starting at the top left, move the correct number of squares along each axis (offsetting by half a square).
-	Vec3 x_result = x_axis * (square_size.x * (desired.x - 0.5));
-	Vec3 y_result = y_axis * (square_size.y * (desired.y - 0.5));
-	return top_left + x_result + y_result;
+static void ResizeBurbBatch(BurbBatch* burbs, s32 capacity)
+{
+	burbs->grid_size.Resize(capacity);
+	burbs->desired_x.Resize(capacity);
+	burbs->desired_y.Resize(capacity);
+	burbs->top_left.Resize(capacity);
+	burbs->top_right.Resize(capacity);
+	burbs->bottom_left.Resize(capacity);
 }
 
 /*
-Calls fscanf to try and parse a line from a text file for interburbul.
-
-Returns the number of elements successfully parsed.
-If not all elements could be parsed, the output will not be modified.
+Parses one line of a CSV file for interburbul into the batch, see RunInterburbul() for the format.
+The row is its index in the batch, which only holds one chunk of the file.
 */
-static s32 ParseBurb(FILE* f, Burb* burb)
+static bool ParseBurb(CsvReader* reader, void* data, s32 row)
 {
+	BurbBatch* burbs = (BurbBatch*)data;
 	s32 s, dx, dy;
 	Vec3 tl, tr, bl;
-	s32 count = fscanf(f, "%d,%d,%d,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf\n", &s, &dx, &dy, &tl.x, &tl.y, &tl.z, &tr.x, &tr.y, &tr.z, &bl.x, &bl.y, &bl.z);
-	if (count == 12) *burb = {s, {dx, dy}, tl, tr, bl};
-	return count;
+	if (!CsvReadField(reader, &s) || !CsvReadField(reader, &dx) || !CsvReadField(reader, &dy)) return false;
+	if (!CsvReadVec3(reader, &tl) || !CsvReadVec3(reader, &tr) || !CsvReadVec3(reader, &bl)) return false;
+
+	burbs->grid_size.Set(row, (double)s);
+	burbs->desired_x.Set(row, (double)dx);
+	burbs->desired_y.Set(row, (double)dy);
+	burbs->top_left.Set(row, tl);
+	burbs->top_right.Set(row, tr);
+	burbs->bottom_left.Set(row, bl);
+	return true;
+}
+
+static void FreeBurbBatch(BurbBatch* burbs)
+{
+	burbs->grid_size.Free();
+	burbs->desired_x.Free();
+	burbs->desired_y.Free();
+	burbs->top_left.Free();
+	burbs->top_right.Free();
+	burbs->bottom_left.Free();
+	burbs->count = 0;
+}
+
+/*
+Same math as Burb::Interburbulate(), but for every puzzle in the batch at once. There's no square root anywhere,
+so this all gets evaluated in a single loop that the compiler can vectorize, when it's assigned to the output.
+The output decides how many puzzles get solved, so it must not have more than the batch.
+*/
+static void InterburbulateBatch(const BurbBatch& burbs, Vec3Batch out)
+{
+	auto x_step = (burbs.top_right - burbs.top_left) * ((burbs.desired_x - 0.5) / burbs.grid_size);
+	auto y_step = (burbs.bottom_left - burbs.top_left) * ((burbs.desired_y - 0.5) / burbs.grid_size);
+	out.Assign(burbs.top_left + x_step + y_step);
+}
+
+// Number of chunks of the file each thread solves before the results are written out. Every chunk's output
+// is held in memory until then, so this is what keeps huge files from needing huge amounts of memory.
+#define BURB_CHUNKS_PER_THREAD 4
+
+// Everything the threads need for SolveBurbChunks(). Each chunk of the file gets its own output table, kept in memory.
+struct BurbStreamJob
+{
+	const CsvFile* file;
+	CsvChunk* chunks;
+	const OutputWriter* columns;
+	OutputWriter* outputs;
+};
+
+/*
+Parses, solves and formats chunks of the puzzles file, one chunk at a time. If a row can't be parsed, the output only
+has the rows before it, and the chunk has the error, see ParseCsvRows().
+*/
+static void SolveBurbChunks(void* data, s32 begin, s32 end)
+{
+	BurbStreamJob* job = (BurbStreamJob*)data;
+	for (s32 c = begin; c < end; ++c)
+	{
+		CsvChunk& chunk = job->chunks[c];
+		s64 start = StartMetricsTimer();
+		BurbBatch burbs = {};
+		ResizeBurbBatch(&burbs, chunk.row_count);
+		bool parsed = ParseCsvRows(*job->file, &chunk, ParseBurb, &burbs, 0);
+		burbs.count = parsed ? chunk.row_count : chunk.error_row - chunk.first_row;
+		RecordLatency(METRIC_CSV_LOAD, start);
+		CountMetric(METRIC_QUERIES, burbs.count);
+
+		Vec3Batch results = Vec3Batch::Allocate(burbs.count);
+		InterburbulateBatch(burbs, results);
+
+		OutputWriter* output = &job->outputs[c];
+		StartOutput(output, nullptr, *job->columns);
+		for (s32 i = 0; i < burbs.count; ++i)
+		{
+			WriteOutputInt(output, chunk.first_row + i);
+			WriteOutputDouble(output, results.x[i], 6);
+			WriteOutputDouble(output, results.y[i], 6);
+			WriteOutputDouble(output, results.z[i], 6);
+			EndOutputRow(output);
+		}
+		results.Free();
+		FreeBurbBatch(&burbs);
+	}
 }
 
 /*
@@ -53,41 +148,62 @@ Each row of the CSV should contain a puzzle (other than the first, which can be
 Rows should be formatted as:
 Grid Size,Desired X, Desired Y, Top Left X, Top Left Y, Top Left Z, Top Right X, Top Right Y, Top Right Z, Bottom Left X, Bottom Left Y, Bottom Left Z
 
+The file is streamed through in chunks, see SolveBurbChunks(). Each thread parses, solves and writes out its own chunks,
+and the results are written out in order, a whole chunk at a time, so files of any size only need a little memory.
+If a row can't be parsed, we still print the solutions for all the rows before it.
+
 Returns 0 if successful, or 1 if an error occured when reading/parsing the file.
 */
 s32 RunInterburbul(const char* file_path)
 {
-	FILE* f = fopen(file_path, "r");
-	if (!f)
-	{
-		printf("Unable to open file %s\n", file_path);
-		fclose(f);
-		return 1;
-	}
-	
-	printf("Index,X,Y,Z\n");
-	s32 parsed_count = 0;
-	Burb burb = {};
-
-	// The first line can optionally be a header, which we will skip.
-	// Otherwise rewind to the start of the file.
-	if (fscanf(f, "%*d,%*d,%*d,%*lf,%*lf,%*lf,%*lf,%*lf,%*lf,%*lf,%*lf,%*lf\n") == 0) fscanf(f, "%*[^\n]\n");
-	else fseek(f, 0, SEEK_SET);
-
-	s32 fields_parsed = 0;
-	while ((fields_parsed = ParseBurb(f, &burb)) == 12)
-	{
-		Vec3 result = burb.Interburbulate();
-		printf("%d,%lf,%lf,%lf\n", parsed_count, result.x, result.y, result.z);
-		++parsed_count;
-	}
-	fclose(f);
+	CsvFile file;
+	if (!OpenCsv(file_path, &file)) return 1;
 
-	if (fields_parsed != 0 && fields_parsed != EOF)
+	ThreadPool pool;
+	StartThreadPool(&pool, 0);
+	s32 chunk_count;
+	s32 row_count;
+	CsvChunk* chunks = SplitCsv(file, &pool, &chunk_count, &row_count);
+
+	s32 window = pool.thread_count * BURB_CHUNKS_PER_THREAD;
+	BurbStreamJob job;
+	job.file = &file;
+	job.outputs = (OutputWriter*)malloc(window * sizeof(OutputWriter));
+
+	OutputWriter output;
+	StartOutput(&output, stdout, output_format);
+	AddOutputColumn(&output, "Index");
+	AddOutputColumn(&output, "X");
+	AddOutputColumn(&output, "Y");
+	AddOutputColumn(&output, "Z");
+	WriteOutputHeader(&output);
+	job.columns = &output;
+
+	bool parsed = true;
+	for (s32 first = 0; first < chunk_count && parsed; first += window)
 	{
-		printf("Unable to parse burb at index %d, is the line formatted correctly?\n", parsed_count);
-		return 1;
+		s32 count = (chunk_count - first < window) ? chunk_count - first : window;
+		job.chunks = chunks + first;
+		RunParallel(&pool, count, 1, SolveBurbChunks, &job);
+
+		// Only the rows before the first bad one get written.
+		for (s32 i = 0; i < count; ++i)
+		{
+			if (parsed) WriteOutputRows(&output, job.outputs[i]);
+			if (parsed && job.chunks[i].error_row >= 0)
+			{
+				FlushOutput(&output);
+				printf("%s\n", job.chunks[i].error);
+				parsed = false;
+			}
+			FinishOutput(&job.outputs[i]);
+		}
 	}
-	else return 0;
 
+	FinishOutput(&output);
+	StopThreadPool(&pool);
+	free(job.outputs);
+	free(chunks);
+	CloseCsv(&file);
+	return parsed ? 0 : 1;
 }
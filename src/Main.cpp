@@ -26,9 +26,57 @@ traveling in the direction opposite this one when we crashed. Our assumption is
 static Vec3 desired_vector = {0.43134830415853,-0.77703970963888,0.4584189461005};
 
 // I'm using symbol IDs 14 and 13 from starmapping in order to compute the vectors, but there may be a more precise combination.
+// The "pairs" mode below tries every combination, and tells you which one lines up best with the rest of the starmap.
+
+static void DumpTraceToStderr()
+{
+	DumpTrace(stderr);
+}
+
+static void WriteMetricsOnExit()
+{
+	if (!WriteMetrics(metrics_path)) printf("Unable to write metrics file %s\n", metrics_path);
+}
 
 s32 main(s32 argc, const char* argv[])
 {
+	// Any mode can start with "--format=csv", "--format=tsv" or "--format=json" to pick how its results table gets printed (see Output.cpp).
+	// It's CSV if you don't, and the rest of the arguments are the same either way.
+	// It can also start with "--trace" or "--trace=categories:level" to print what the solver traced to stderr once it's done,
+	// for example "--trace=first-symbol,descent:stage" (see Trace.cpp). That only works in debug builds.
+	// It can also start with "--metrics=file_path" to time each stage and count the odd cases, and write them to that file
+	// once it's done (see Metrics.cpp). Paths ending in .json get JSON, anything else gets the Prometheus text format.
+	while (argc > 1 && strncmp(argv[1], "--", 2) == 0)
+	{
+		if (strncmp(argv[1], "--format=", 9) == 0)
+		{
+			if (!ParseOutputFormat(argv[1] + 9, &output_format))
+			{
+				printf("Unknown output format %s, it needs to be csv, tsv or json.\n", argv[1] + 9);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[1], "--trace") == 0 || strncmp(argv[1], "--trace=", 8) == 0)
+		{
+			if (!ParseTraceFilter(argv[1][7] ? argv[1] + 8 : ""))
+			{
+				printf("Unknown trace filter %s, it needs to be categories (all, parsing, orientation, first-symbol, descent) separated by commas, optionally followed by :stage or :detail.\n", argv[1] + 8);
+				return 1;
+			}
+			if (TRACE_ENABLED) atexit(DumpTraceToStderr);
+			else fprintf(stderr, "Tracing is compiled out of release builds, build in debug mode to use --trace.\n");
+		}
+		else if (strncmp(argv[1], "--metrics=", 10) == 0 && argv[1][10])
+		{
+			metrics_enabled = true;
+			metrics_path = argv[1] + 10;
+			atexit(WriteMetricsOnExit);
+		}
+		else break;
+		--argc;
+		++argv;
+	}
+
 	// Call the program either as "exe_name interburbulate" or "exe_name interburbulate file_path" to solve interburbul puzzles.
 	// If you don't specify a file path, it will try to read from "burbs.csv".
 	if (argc > 1 && strcmp(argv[1], "interburbulate") == 0)
@@ -37,8 +85,112 @@ s32 main(s32 argc, const char* argv[])
 		return RunInterburbul(file_path);
 	}
 	
+	// Call the program as "exe_name batch id1 id2 queries_path" or "exe_name batch id1 id2 queries_path triangles_path starmap_path mapping_2d_path thread_count beam_width constraints_path"
+	// to solve an address for every vector in the queries file. If you don't specify the other file paths, it will use the same defaults as below.
+	// If you don't specify a thread count (or it's 0), it will use one thread per core.
+	// If you give a beam width (4 is plenty), it searches for the address that decodes closest to each vector, instead of the one containing it.
+	// If you give a constraints file, it finds the closest address that only uses the symbols each slot allows (see Constraints.cpp).
+	if (argc > 4 && strcmp(argv[1], "batch") == 0)
+	{
+		s32 symbol1 = atoi(argv[2]);
+		s32 symbol2 = atoi(argv[3]);
+		const char* queries_path = argv[4];
+		const char* triangles_path = (argc > 5) ? argv[5] : "triangles.csv";
+		const char* starmap_path = (argc > 6) ? argv[6] : "starmap.csv";
+		const char* mapping_2d_path = (argc > 7) ? argv[7] : "mapping2d.csv";
+		s32 thread_count = (argc > 8) ? atoi(argv[8]) : 0;
+		s32 beam_width = (argc > 9) ? atoi(argv[9]) : 0;
+		const char* constraints_path = (argc > 10) ? argv[10] : nullptr;
+		return RunBatch(symbol1, symbol2, queries_path, triangles_path, starmap_path, mapping_2d_path, thread_count, beam_width, constraints_path);
+	}
+
+	// Call the program as "exe_name deep id1 id2 queries_path depth", with the same optional arguments as decode, to solve addresses
+	// with more levels of subdivision than the stargate takes (up to 32), for modded gates or checking how precise a vector needs to be.
+	if (argc > 5 && strcmp(argv[1], "deep") == 0)
+	{
+		s32 symbol1 = atoi(argv[2]);
+		s32 symbol2 = atoi(argv[3]);
+		const char* queries_path = argv[4];
+		s32 depth = atoi(argv[5]);
+		const char* triangles_path = (argc > 6) ? argv[6] : "triangles.csv";
+		const char* starmap_path = (argc > 7) ? argv[7] : "starmap.csv";
+		const char* mapping_2d_path = (argc > 8) ? argv[8] : "mapping2d.csv";
+		s32 thread_count = (argc > 9) ? atoi(argv[9]) : 0;
+		return RunDeepBatch(symbol1, symbol2, queries_path, depth, triangles_path, starmap_path, mapping_2d_path, thread_count);
+	}
+
+	// Call the program as "exe_name subdivide id1 id2 queries_path factor depth", with the same optional arguments as decode, to solve
+	// addresses for a gate that splits each triangle edge into factor pieces, depth times. The real gate is factor 8 and depth 7.
+	if (argc > 6 && strcmp(argv[1], "subdivide") == 0)
+	{
+		s32 symbol1 = atoi(argv[2]);
+		s32 symbol2 = atoi(argv[3]);
+		const char* queries_path = argv[4];
+		s32 factor = atoi(argv[5]);
+		s32 depth = atoi(argv[6]);
+		const char* triangles_path = (argc > 7) ? argv[7] : "triangles.csv";
+		const char* starmap_path = (argc > 8) ? argv[8] : "starmap.csv";
+		const char* mapping_2d_path = (argc > 9) ? argv[9] : "mapping2d.csv";
+		s32 thread_count = (argc > 10) ? atoi(argv[10]) : 0;
+		return RunSubdivisionBatch(symbol1, symbol2, queries_path, factor, depth, triangles_path, starmap_path, mapping_2d_path, thread_count);
+	}
+
+	// Call the program as "exe_name decode id1 id2 addresses_path", with the same optional arguments as batch, to turn
+	// every address in the addresses file back into a direction.
+	if (argc > 4 && strcmp(argv[1], "decode") == 0)
+	{
+		s32 symbol1 = atoi(argv[2]);
+		s32 symbol2 = atoi(argv[3]);
+		const char* addresses_path = argv[4];
+		const char* triangles_path = (argc > 5) ? argv[5] : "triangles.csv";
+		const char* starmap_path = (argc > 6) ? argv[6] : "starmap.csv";
+		const char* mapping_2d_path = (argc > 7) ? argv[7] : "mapping2d.csv";
+		s32 thread_count = (argc > 8) ? atoi(argv[8]) : 0;
+		return RunDecode(symbol1, symbol2, addresses_path, triangles_path, starmap_path, mapping_2d_path, thread_count);
+	}
+
+	// Call the program as "exe_name compile-seed id1 id2 pack_path" or "exe_name compile-seed id1 id2 pack_path triangles_path starmap_path mapping_2d_path"
+	// to orient the ball once and save it to a seed pack. The ball, batch, decode, subdivide and deep modes can be given the pack
+	// instead of the triangles path, which skips loading the other files and orienting the ball. They still need the IDs, which have to match the pack's.
+	if (argc > 4 && strcmp(argv[1], "compile-seed") == 0)
+	{
+		s32 symbol1 = atoi(argv[2]);
+		s32 symbol2 = atoi(argv[3]);
+		const char* pack_path = argv[4];
+		const char* triangles_path = (argc > 5) ? argv[5] : "triangles.csv";
+		const char* starmap_path = (argc > 6) ? argv[6] : "starmap.csv";
+		const char* mapping_2d_path = (argc > 7) ? argv[7] : "mapping2d.csv";
+		return RunCompileSeed(symbol1, symbol2, pack_path, triangles_path, starmap_path, mapping_2d_path);
+	}
+
+	// Call the program as "exe_name serve id1 id2" or "exe_name serve id1 id2 socket_path triangles_path starmap_path mapping_2d_path thread_count"
+	// to load the ball once, and then answer solve/decode/burb requests one line at a time (see Serve.cpp). Without a socket path
+	// (or with "-"), requests come from stdin. A seed pack from compile-seed works in place of the triangles path.
+	if (argc > 3 && strcmp(argv[1], "serve") == 0)
+	{
+		s32 symbol1 = atoi(argv[2]);
+		s32 symbol2 = atoi(argv[3]);
+		const char* socket_path = (argc > 4 && strcmp(argv[4], "-") != 0) ? argv[4] : nullptr;
+		const char* triangles_path = (argc > 5) ? argv[5] : "triangles.csv";
+		const char* starmap_path = (argc > 6) ? argv[6] : "starmap.csv";
+		const char* mapping_2d_path = (argc > 7) ? argv[7] : "mapping2d.csv";
+		s32 thread_count = (argc > 8) ? atoi(argv[8]) : 0;
+		return RunServe(symbol1, symbol2, socket_path, triangles_path, starmap_path, mapping_2d_path, thread_count);
+	}
+
+	// Call the program as "exe_name pairs" or "exe_name pairs triangles_path starmap_path thread_count" to try every pair of starmap
+	// vectors as the two reference symbols, and find the one that lines up best with the rest of them.
+	if (argc > 1 && strcmp(argv[1], "pairs") == 0)
+	{
+		const char* triangles_path = (argc > 2) ? argv[2] : "triangles.csv";
+		const char* starmap_path = (argc > 3) ? argv[3] : "starmap.csv";
+		s32 thread_count = (argc > 4) ? atoi(argv[4]) : 0;
+		return RunReferencePairSearch(triangles_path, starmap_path, thread_count);
+	}
+
 	// Call the program as "exe_name ball id1 id2" or "exe_name ball id1 id2 triangles_path starmap_path" to solve the symbol direction vectors.
 	// If you don't specify file paths, it will try to read from "triangles.csv" and "starmap.csv".
+	// In every mode, passing 0 for both IDs fits the orientation to every starmap vector at once, instead of just two of them.
 	if (argc > 2)
 	{
 		s32 symbol1 = atoi(argv[1]);
@@ -46,11 +198,12 @@ s32 main(s32 argc, const char* argv[])
 		const char* triangles_path = (argc > 3) ? argv[3] : "triangles.csv";
 		const char* starmap_path = (argc > 4) ? argv[4] : "starmap.csv";
 		const char* mapping_2d_path = (argc > 5) ? argv[5] : "mapping2d.csv";
-		printf("Computing symbol vectors using starmap symbol IDs %d and %d, from triangles file %s, starmap file %s\n", symbol1, symbol2, triangles_path, starmap_path);
+		if (symbol1 == 0 && symbol2 == 0) printf("Computing symbol vectors using every starmap vector, from triangles file %s, starmap file %s\n", triangles_path, starmap_path);
+		else printf("Computing symbol vectors using starmap symbol IDs %d and %d, from triangles file %s, starmap file %s\n", symbol1, symbol2, triangles_path, starmap_path);
 
 		return SolveRotation(symbol1, symbol2, desired_vector, triangles_path, starmap_path, mapping_2d_path);
 	}
 
-	printf("Valid Usage:\ninterburbulate file_path\nball symbol1 symbol2 triangles_path starmap_path\n");
+	printf("Valid Usage (any of these can start with --format=csv|tsv|json, --trace=categories:level and --metrics=file_path):\ninterburbulate file_path\nball symbol1 symbol2 triangles_path starmap_path\nbatch symbol1 symbol2 queries_path triangles_path starmap_path mapping_2d_path thread_count beam_width constraints_path\ndecode symbol1 symbol2 addresses_path triangles_path starmap_path mapping_2d_path thread_count\nsubdivide symbol1 symbol2 queries_path factor depth triangles_path starmap_path mapping_2d_path thread_count\ndeep symbol1 symbol2 queries_path depth triangles_path starmap_path mapping_2d_path thread_count\npairs triangles_path starmap_path thread_count\ncompile-seed symbol1 symbol2 pack_path triangles_path starmap_path mapping_2d_path\nserve symbol1 symbol2 socket_path triangles_path starmap_path mapping_2d_path thread_count\n");
 	return 1;
 }
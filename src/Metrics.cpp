@@ -0,0 +1,335 @@
+#include "Core.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+/*
+Latency histograms and counters for each stage of solving, so we can see where the time actually goes per query.
+They're off unless the command line asks for them with --metrics (see main()), and then they get written to a file
+when the program exits, either as Prometheus text or JSON.
+
+Every thread records into its own shard, so there's never any contention, and the shards get added together whenever
+someone asks for the totals. Only the owning thread writes to a shard, so the counts are atomics just so that merging
+can read them while they're still being written, and each one is a plain load and store rather than a locked add.
+
+The histograms work like HDR histograms: the buckets get wider as the values get bigger, so every bucket is within about
+6% of the values in it, whether they're nanoseconds or minutes, and the whole range fits in under a thousand buckets.
+*/
+
+// Stages we time. Each descent level also gets its own histogram, see RecordLevelLatency().
+enum MetricStage
+{
+	METRIC_CSV_LOAD,
+	METRIC_ORIENTATION,
+	METRIC_FIRST_FACE,
+	METRIC_DESCENT, // Every level at once, for the solvers that don't go one level at a time.
+	METRIC_FORMAT, // Formatting one row of output.
+	METRIC_WRITE, // Writing a buffer of output.
+	METRIC_STAGE_COUNT,
+};
+
+static const char* metric_stage_names[METRIC_STAGE_COUNT] = {"csv_load", "orientation", "first_face", "descent", "format", "write"};
+
+// Most levels of descent that get their own histogram. Deeper levels are lumped in with the last one.
+#define MAX_METRIC_LEVELS 16
+
+enum MetricCounter
+{
+	METRIC_QUERIES, // Vectors we tried to solve.
+	METRIC_UNSOLVED, // Vectors that didn't get an address.
+	METRIC_DEGENERACIES, // Rays and faces that were within EPSILON of parallel, or of the origin.
+	METRIC_DISAGREEMENTS, // Levels where the interpolated triangle doesn't pass the raycast sanity check.
+	METRIC_EDGE_HITS, // Vectors within the smallest subdivision of their face's edge, where rounding could pick a neighbour.
+	METRIC_COUNTER_COUNT,
+};
+
+static const char* metric_counter_names[METRIC_COUNTER_COUNT] = {"queries", "unsolved", "degeneracies", "disagreements", "edge_hits"};
+
+// Each power of two gets split into this many buckets (as a power of two).
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKET_COUNT ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+// Set from the command line. Nothing gets timed or counted without it.
+static bool metrics_enabled = false;
+static const char* metrics_path = nullptr; // Where the metrics get written, when asked for and when the program exits.
+
+// Latencies are in nanoseconds.
+struct LatencyHistogram
+{
+	std::atomic<u64> buckets[HISTOGRAM_BUCKET_COUNT];
+	std::atomic<u64> count;
+	std::atomic<u64> sum;
+	std::atomic<u64> max;
+};
+
+struct MetricsShard
+{
+	LatencyHistogram stages[METRIC_STAGE_COUNT];
+	LatencyHistogram levels[MAX_METRIC_LEVELS];
+	std::atomic<u64> counters[METRIC_COUNTER_COUNT];
+	MetricsShard* next;
+};
+
+// Same as a LatencyHistogram, but not atomic, for adding up the shards.
+struct HistogramTotals
+{
+	u64 buckets[HISTOGRAM_BUCKET_COUNT];
+	u64 count;
+	u64 sum;
+	u64 max;
+};
+
+struct MetricsTotals
+{
+	HistogramTotals stages[METRIC_STAGE_COUNT];
+	HistogramTotals levels[MAX_METRIC_LEVELS];
+	u64 counters[METRIC_COUNTER_COUNT];
+};
+
+// Every shard that belongs to a running thread. When a thread exits, its shard gets added to metrics_retired instead.
+static std::mutex metrics_lock;
+static MetricsShard* metrics_shards = nullptr;
+static MetricsTotals metrics_retired;
+
+static s32 GetHistogramBucket(u64 value)
+{
+	if (value < HISTOGRAM_SUB_BUCKETS) return (s32)value;
+	s32 magnitude = LastSetBit64(value) - HISTOGRAM_SUB_BITS;
+	return (magnitude + 1) * HISTOGRAM_SUB_BUCKETS + (s32)((value >> magnitude) - HISTOGRAM_SUB_BUCKETS);
+}
+
+// Largest value that goes in a bucket.
+static u64 GetHistogramBucketMax(s32 bucket)
+{
+	if (bucket < HISTOGRAM_SUB_BUCKETS) return (u64)bucket;
+	s32 magnitude = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+	u64 sub = (u64)(bucket % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS);
+	return ((sub + 1) << magnitude) - 1;
+}
+
+static void AddHistogramToTotals(const LatencyHistogram& histogram, HistogramTotals* totals)
+{
+	for (s32 i = 0; i < HISTOGRAM_BUCKET_COUNT; ++i) totals->buckets[i] += histogram.buckets[i].load(std::memory_order_relaxed);
+	totals->count += histogram.count.load(std::memory_order_relaxed);
+	totals->sum += histogram.sum.load(std::memory_order_relaxed);
+	u64 max = histogram.max.load(std::memory_order_relaxed);
+	if (max > totals->max) totals->max = max;
+}
+
+static void AddShardToTotals(const MetricsShard& shard, MetricsTotals* totals)
+{
+	for (s32 i = 0; i < METRIC_STAGE_COUNT; ++i) AddHistogramToTotals(shard.stages[i], &totals->stages[i]);
+	for (s32 i = 0; i < MAX_METRIC_LEVELS; ++i) AddHistogramToTotals(shard.levels[i], &totals->levels[i]);
+	for (s32 i = 0; i < METRIC_COUNTER_COUNT; ++i) totals->counters[i] += shard.counters[i].load(std::memory_order_relaxed);
+}
+
+// Adds a thread's shard to the retired totals when the thread exits, so threads can come and go without losing anything.
+struct MetricsShardOwner
+{
+	MetricsShard* shard;
+
+	~MetricsShardOwner()
+	{
+		if (!shard) return;
+		std::lock_guard<std::mutex> guard(metrics_lock);
+		AddShardToTotals(*shard, &metrics_retired);
+		for (MetricsShard** s = &metrics_shards; *s; s = &(*s)->next)
+		{
+			if (*s != shard) continue;
+			*s = shard->next;
+			break;
+		}
+		delete shard;
+	}
+};
+
+static thread_local MetricsShard* metrics_shard = nullptr;
+static thread_local MetricsShardOwner metrics_shard_owner;
+
+static MetricsShard* GetMetricsShard()
+{
+	if (metrics_shard) return metrics_shard;
+	MetricsShard* shard = new MetricsShard();
+	std::lock_guard<std::mutex> guard(metrics_lock);
+	shard->next = metrics_shards;
+	metrics_shards = shard;
+	metrics_shard_owner.shard = shard;
+	metrics_shard = shard;
+	return shard;
+}
+
+// Only the owning thread ever writes, so this doesn't need to be a locked add.
+inline void AddRelaxed(std::atomic<u64>* value, u64 amount)
+{
+	value->store(value->load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+static void RecordHistogram(LatencyHistogram* histogram, u64 nanoseconds)
+{
+	AddRelaxed(&histogram->buckets[GetHistogramBucket(nanoseconds)], 1);
+	AddRelaxed(&histogram->count, 1);
+	AddRelaxed(&histogram->sum, nanoseconds);
+	if (nanoseconds > histogram->max.load(std::memory_order_relaxed)) histogram->max.store(nanoseconds, std::memory_order_relaxed);
+}
+
+inline s64 GetNanoseconds()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Starts timing something, pass the result to RecordLatency() when it's done. Doesn't even read the clock if metrics are off.
+inline s64 StartMetricsTimer()
+{
+	return metrics_enabled ? GetNanoseconds() : 0;
+}
+
+void RecordLatency(MetricStage stage, s64 start)
+{
+	if (!metrics_enabled) return;
+	s64 elapsed = GetNanoseconds() - start;
+	RecordHistogram(&GetMetricsShard()->stages[stage], (elapsed > 0) ? (u64)elapsed : 0);
+}
+
+// Same as RecordLatency(), but for one level of descent, where level 0 is the first one after the first symbol.
+void RecordLevelLatency(s32 level, s64 start)
+{
+	if (!metrics_enabled) return;
+	s64 elapsed = GetNanoseconds() - start;
+	RecordHistogram(&GetMetricsShard()->levels[(level < MAX_METRIC_LEVELS) ? level : MAX_METRIC_LEVELS - 1], (elapsed > 0) ? (u64)elapsed : 0);
+}
+
+inline void CountMetric(MetricCounter counter, u64 amount = 1)
+{
+	if (metrics_enabled) AddRelaxed(&GetMetricsShard()->counters[counter], amount);
+}
+
+/*
+Adds up every thread's metrics so far. Threads can keep recording while this runs, in which case we get some of
+what they're in the middle of recording, but never anything torn. The totals are big, so don't put them on the stack.
+*/
+void MergeMetrics(MetricsTotals* out)
+{
+	std::lock_guard<std::mutex> guard(metrics_lock);
+	*out = metrics_retired;
+	for (MetricsShard* shard = metrics_shards; shard; shard = shard->next) AddShardToTotals(*shard, out);
+}
+
+// Smallest value that at least a fraction of the histogram is at or under, in nanoseconds. Rounded up to its bucket.
+static u64 GetHistogramPercentile(const HistogramTotals& histogram, double fraction)
+{
+	if (histogram.count == 0) return 0;
+	u64 target = (u64)(fraction * (double)histogram.count + 0.5);
+	if (target < 1) target = 1;
+	u64 seen = 0;
+	for (s32 i = 0; i < HISTOGRAM_BUCKET_COUNT; ++i)
+	{
+		seen += histogram.buckets[i];
+		if (seen < target) continue;
+		u64 value = GetHistogramBucketMax(i);
+		return (value < histogram.max) ? value : histogram.max;
+	}
+	return histogram.max;
+}
+
+// Name for a histogram in the exported metrics. Levels are named descent_level_1 and up.
+static void GetHistogramName(s32 index, char* out, s32 size)
+{
+	if (index < METRIC_STAGE_COUNT) snprintf(out, size, "%s", metric_stage_names[index]);
+	else snprintf(out, size, "descent_level_%d", index - METRIC_STAGE_COUNT + 1);
+}
+
+// Histograms for stages and levels, in the order they get exported.
+static const HistogramTotals& GetExportedHistogram(const MetricsTotals& totals, s32 index)
+{
+	return (index < METRIC_STAGE_COUNT) ? totals.stages[index] : totals.levels[index - METRIC_STAGE_COUNT];
+}
+
+/*
+Prometheus histograms have cumulative buckets, where each one counts the values up to and including its bound. We write
+every bucket up to the last one with something in it, plus +Inf, so the bounds are the same from one export to the next
+(apart from new ones on the end), and rate() over them works.
+*/
+static void WritePrometheusMetrics(FILE* file, const MetricsTotals& totals)
+{
+	fprintf(file, "# HELP vecfinder_stage_seconds Time spent in each stage of solving.\n");
+	fprintf(file, "# TYPE vecfinder_stage_seconds histogram\n");
+	for (s32 h = 0; h < METRIC_STAGE_COUNT + MAX_METRIC_LEVELS; ++h)
+	{
+		const HistogramTotals& histogram = GetExportedHistogram(totals, h);
+		if (histogram.count == 0) continue;
+		char name[32];
+		GetHistogramName(h, name, sizeof(name));
+		s32 last_bucket = HISTOGRAM_BUCKET_COUNT - 1;
+		while (last_bucket > 0 && histogram.buckets[last_bucket] == 0) --last_bucket;
+		u64 seen = 0;
+		for (s32 i = 0; i <= last_bucket; ++i)
+		{
+			seen += histogram.buckets[i];
+			fprintf(file, "vecfinder_stage_seconds_bucket{stage=\"%s\",le=\"%.9g\"} %llu\n", name, (double)GetHistogramBucketMax(i) * 1e-9, (unsigned long long)seen);
+		}
+		fprintf(file, "vecfinder_stage_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %llu\n", name, (unsigned long long)histogram.count);
+		fprintf(file, "vecfinder_stage_seconds_sum{stage=\"%s\"} %.9f\n", name, (double)histogram.sum * 1e-9);
+		fprintf(file, "vecfinder_stage_seconds_count{stage=\"%s\"} %llu\n", name, (unsigned long long)histogram.count);
+	}
+
+	for (s32 i = 0; i < METRIC_COUNTER_COUNT; ++i)
+	{
+		fprintf(file, "# TYPE vecfinder_%s_total counter\n", metric_counter_names[i]);
+		fprintf(file, "vecfinder_%s_total %llu\n", metric_counter_names[i], (unsigned long long)totals.counters[i]);
+	}
+}
+
+// JSON has every stage's summary and percentiles, plus the non-empty buckets as [largest value, count] pairs.
+static void WriteJsonMetrics(FILE* file, const MetricsTotals& totals)
+{
+	fprintf(file, "{\n\t\"stages\": {");
+	bool first = true;
+	for (s32 h = 0; h < METRIC_STAGE_COUNT + MAX_METRIC_LEVELS; ++h)
+	{
+		const HistogramTotals& histogram = GetExportedHistogram(totals, h);
+		if (histogram.count == 0) continue;
+		char name[32];
+		GetHistogramName(h, name, sizeof(name));
+		fprintf(file, "%s\n\t\t\"%s\": {\"count\": %llu, \"sum_ns\": %llu, \"max_ns\": %llu", first ? "" : ",", name, (unsigned long long)histogram.count, (unsigned long long)histogram.sum, (unsigned long long)histogram.max);
+		fprintf(file, ", \"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"buckets\": [", (unsigned long long)GetHistogramPercentile(histogram, 0.5), (unsigned long long)GetHistogramPercentile(histogram, 0.9), (unsigned long long)GetHistogramPercentile(histogram, 0.99), (unsigned long long)GetHistogramPercentile(histogram, 0.999));
+		bool first_bucket = true;
+		for (s32 i = 0; i < HISTOGRAM_BUCKET_COUNT; ++i)
+		{
+			if (histogram.buckets[i] == 0) continue;
+			fprintf(file, "%s[%llu, %llu]", first_bucket ? "" : ", ", (unsigned long long)GetHistogramBucketMax(i), (unsigned long long)histogram.buckets[i]);
+			first_bucket = false;
+		}
+		fprintf(file, "]}");
+		first = false;
+	}
+	fprintf(file, "\n\t},\n\t\"counters\": {");
+	for (s32 i = 0; i < METRIC_COUNTER_COUNT; ++i) fprintf(file, "%s\n\t\t\"%s\": %llu", (i > 0) ? "," : "", metric_counter_names[i], (unsigned long long)totals.counters[i]);
+	fprintf(file, "\n\t}\n}\n");
+}
+
+/*
+Merges every thread's metrics, and writes them to a file. Files ending in .json get JSON, anything else gets the Prometheus
+text format, which works with node_exporter's textfile collector. Returns false if the file couldn't be written.
+This doesn't print anything, since serve mode calls it while stdout is full of responses.
+*/
+bool WriteMetrics(const char* path)
+{
+	MetricsTotals* totals = (MetricsTotals*)calloc(1, sizeof(MetricsTotals));
+	MergeMetrics(totals);
+
+	FILE* file = fopen(path, "wb");
+	if (!file)
+	{
+		free(totals);
+		return false;
+	}
+	size_t length = strlen(path);
+	if (length >= 5 && strcmp(path + length - 5, ".json") == 0) WriteJsonMetrics(file, *totals);
+	else WritePrometheusMetrics(file, *totals);
+	bool written = !ferror(file);
+	fclose(file);
+	free(totals);
+	return written;
+}
@@ -0,0 +1,234 @@
+#include "Core.h"
+
+#include <charconv>
+#include <stdarg.h>
+
+/*
+Every mode prints its results as a table, one row per query. With millions of rows, printf ends up taking longer than
+solving them did, since it has to parse the format string and lock the stream for every call. So instead, rows get written
+into a big buffer with std::to_chars (which is what MSVC's printf should have been: exact, and no locale), and the buffer
+is flushed in big writes.
+
+Tables can come out as CSV (the default), TSV, or JSON lines with one object per row, picked with --format on the command
+line. Numbers look exactly the same as they did with printf, since to_chars rounds the same way.
+*/
+
+enum OutputFormat
+{
+	OUTPUT_CSV,
+	OUTPUT_TSV,
+	OUTPUT_JSON_LINES,
+};
+
+// Format every table gets written in. Set once from the command line, see main().
+static OutputFormat output_format = OUTPUT_CSV;
+
+// How full the buffer gets before it's flushed.
+#define OUTPUT_FLUSH_SIZE (1 << 20)
+
+// Room we make in the buffer before writing each field. Huge numbers in fixed notation can need more, and get it.
+#define OUTPUT_FIELD_SIZE 128
+
+#define MAX_OUTPUT_COLUMNS 40
+#define MAX_OUTPUT_COLUMN_NAME 40
+
+// Pass as the precision to WriteOutputDouble() for the shortest digits that still read back as the same double.
+#define OUTPUT_SHORTEST -1
+
+struct OutputWriter
+{
+	FILE* file; // Where the buffer gets flushed to, or null to keep everything in the buffer.
+	OutputFormat format;
+	char* buffer;
+	s64 size;
+	s64 capacity;
+	s32 column_count;
+	s32 column; // Index of the next field in the current row.
+	s64 row_start; // When we started formatting the current row, see StartMetricsTimer().
+	char names[MAX_OUTPUT_COLUMNS][MAX_OUTPUT_COLUMN_NAME]; // Column names, for the header, or the keys in JSON.
+};
+
+// Starts a table, which gets flushed to file, or kept in memory if file is null. Add the columns next.
+void StartOutput(OutputWriter* writer, FILE* file, OutputFormat format)
+{
+	writer->file = file;
+	writer->format = format;
+	writer->capacity = OUTPUT_FLUSH_SIZE + OUTPUT_FIELD_SIZE;
+	writer->buffer = (char*)malloc(writer->capacity);
+	writer->size = 0;
+	writer->column_count = 0;
+	writer->column = 0;
+	writer->row_start = 0;
+}
+
+// Starts a table with the same columns as another one.
+void StartOutput(OutputWriter* writer, FILE* file, const OutputWriter& columns)
+{
+	StartOutput(writer, file, columns.format);
+	writer->column_count = columns.column_count;
+	memcpy(writer->names, columns.names, sizeof(writer->names));
+}
+
+// Adds a column, with a printf style name. Names with quotes or backslashes would need escaping in JSON, so don't use them.
+void AddOutputColumn(OutputWriter* writer, const char* format, ...)
+{
+	assert(writer->column_count < MAX_OUTPUT_COLUMNS);
+	va_list args;
+	va_start(args, format);
+	vsnprintf(writer->names[writer->column_count++], MAX_OUTPUT_COLUMN_NAME, format, args);
+	va_end(args);
+}
+
+void FlushOutput(OutputWriter* writer)
+{
+	if (writer->file && writer->size > 0)
+	{
+		s64 start = StartMetricsTimer();
+		fwrite(writer->buffer, 1, (size_t)writer->size, writer->file);
+		RecordLatency(METRIC_WRITE, start);
+	}
+	if (writer->file) writer->size = 0;
+}
+
+// Makes sure there's room for at least size more bytes.
+static void ReserveOutput(OutputWriter* writer, s64 size)
+{
+	if (writer->size + size <= writer->capacity) return;
+	if (writer->file && writer->size > 0)
+	{
+		FlushOutput(writer);
+		if (size <= writer->capacity) return;
+	}
+	while (writer->size + size > writer->capacity) writer->capacity *= 2;
+	writer->buffer = (char*)realloc(writer->buffer, writer->capacity);
+}
+
+static void WriteOutputBytes(OutputWriter* writer, const char* data, s64 size)
+{
+	ReserveOutput(writer, size);
+	memcpy(writer->buffer + writer->size, data, size);
+	writer->size += size;
+}
+
+// Writes whatever goes before a field: the separator, and the key for JSON.
+static void BeginOutputField(OutputWriter* writer)
+{
+	if (writer->column == 0) writer->row_start = StartMetricsTimer();
+	ReserveOutput(writer, OUTPUT_FIELD_SIZE + MAX_OUTPUT_COLUMN_NAME);
+	char* p = writer->buffer + writer->size;
+	if (writer->format == OUTPUT_JSON_LINES)
+	{
+		*p++ = (writer->column == 0) ? '{' : ',';
+		*p++ = '"';
+		const char* name = (writer->column < writer->column_count) ? writer->names[writer->column] : "";
+		size_t length = strlen(name);
+		memcpy(p, name, length);
+		p += length;
+		*p++ = '"';
+		*p++ = ':';
+	}
+	else if (writer->column > 0) *p++ = (writer->format == OUTPUT_TSV) ? '\t' : ',';
+	writer->size = p - writer->buffer;
+	++writer->column;
+}
+
+// Writes the header row, if the format has one.
+void WriteOutputHeader(OutputWriter* writer)
+{
+	if (writer->format == OUTPUT_JSON_LINES) return;
+	for (s32 i = 0; i < writer->column_count; ++i)
+	{
+		if (i > 0) WriteOutputBytes(writer, (writer->format == OUTPUT_TSV) ? "\t" : ",", 1);
+		WriteOutputBytes(writer, writer->names[i], strlen(writer->names[i]));
+	}
+	WriteOutputBytes(writer, "\n", 1);
+}
+
+void WriteOutputInt(OutputWriter* writer, s64 value)
+{
+	BeginOutputField(writer);
+	std::to_chars_result result = std::to_chars(writer->buffer + writer->size, writer->buffer + writer->capacity, value);
+	writer->size = result.ptr - writer->buffer;
+}
+
+// Shared by the double writers. Grows the buffer until the number fits, since fixed notation can get long.
+template <typename... Args>
+static void WriteOutputChars(OutputWriter* writer, double value, Args... args)
+{
+	// JSON doesn't have infinity or NaN.
+	if (writer->format == OUTPUT_JSON_LINES && !(value - value == 0.0))
+	{
+		WriteOutputBytes(writer, "null", 4);
+		return;
+	}
+
+	while (true)
+	{
+		std::to_chars_result result = std::to_chars(writer->buffer + writer->size, writer->buffer + writer->capacity, value, args...);
+		if (result.ec == std::errc())
+		{
+			writer->size = result.ptr - writer->buffer;
+			return;
+		}
+		ReserveOutput(writer, writer->capacity - writer->size + OUTPUT_FIELD_SIZE);
+	}
+}
+
+// Writes a double with a fixed number of digits after the decimal point, same as printf("%.*f"), or OUTPUT_SHORTEST.
+void WriteOutputDouble(OutputWriter* writer, double value, s32 precision)
+{
+	BeginOutputField(writer);
+	if (precision == OUTPUT_SHORTEST) WriteOutputChars(writer, value);
+	else WriteOutputChars(writer, value, std::chars_format::fixed, precision);
+}
+
+// Writes a double with a number of significant digits, same as printf("%.*g").
+void WriteOutputDoubleSignificant(OutputWriter* writer, double value, s32 digits)
+{
+	BeginOutputField(writer);
+	WriteOutputChars(writer, value, std::chars_format::general, digits);
+}
+
+// Writes a field with nothing in it, which is null in JSON.
+void WriteOutputEmpty(OutputWriter* writer)
+{
+	BeginOutputField(writer);
+	if (writer->format == OUTPUT_JSON_LINES) WriteOutputBytes(writer, "null", 4);
+}
+
+void EndOutputRow(OutputWriter* writer)
+{
+	if (writer->format == OUTPUT_JSON_LINES) WriteOutputBytes(writer, (writer->column > 0) ? "}\n" : "{}\n", (writer->column > 0) ? 2 : 3);
+	else WriteOutputBytes(writer, "\n", 1);
+	if (writer->column > 0) RecordLatency(METRIC_FORMAT, writer->row_start);
+	writer->column = 0;
+	if (writer->file && writer->size >= OUTPUT_FLUSH_SIZE) FlushOutput(writer);
+}
+
+// Appends everything in another table's buffer, for tables that were written in pieces on other threads.
+void WriteOutputRows(OutputWriter* writer, const OutputWriter& rows)
+{
+	WriteOutputBytes(writer, rows.buffer, rows.size);
+	if (writer->file && writer->size >= OUTPUT_FLUSH_SIZE) FlushOutput(writer);
+}
+
+// Flushes whatever's left, and frees the buffer.
+void FinishOutput(OutputWriter* writer)
+{
+	FlushOutput(writer);
+	if (writer->file) fflush(writer->file);
+	free(writer->buffer);
+	writer->buffer = nullptr;
+	writer->size = 0;
+	writer->capacity = 0;
+}
+
+// Parses the name of a format from the command line. Returns false if it isn't one.
+bool ParseOutputFormat(const char* name, OutputFormat* out)
+{
+	if (strcmp(name, "csv") == 0) *out = OUTPUT_CSV;
+	else if (strcmp(name, "tsv") == 0) *out = OUTPUT_TSV;
+	else if (strcmp(name, "json") == 0 || strcmp(name, "jsonl") == 0) *out = OUTPUT_JSON_LINES;
+	else return false;
+	return true;
+}
@@ -0,0 +1,188 @@
+#include "Core.h"
+
+/*
+LoadBall() orients the ball with two starmap vectors that we pick by hand, and every other starmap vector is only used to
+check how well that worked. This tries every pair of starmap vectors as the reference pair instead, and scores each one
+by how far the other vectors end up from their computed symbol directions, so we can see which pair is the most precise.
+
+Pairs are ordered, since the first vector lines up exactly and the second only decides how the ball is rolled around it.
+The files are only parsed once, and each pair only needs a rotation, so this doesn't build a whole Ball for every pair.
+Each symbol can only have one starmap vector, so pairs are just two different symbol IDs.
+*/
+
+// Number of pairs each thread scores at a time in ScoreReferencePairs().
+#define REFERENCE_PAIR_CHUNK_SIZE 16
+
+// How many of the best pairs RunReferencePairSearch() prints.
+#define REFERENCE_PAIR_REPORT_COUNT 10
+
+struct ReferencePair
+{
+	s32 first; // Symbol ID of the vector that lines up exactly.
+	s32 second; // Symbol ID of the vector that decides the roll.
+	s32 order; // Where the pair comes in ScoreReferencePairs(), to keep the sorting stable.
+	bool valid; // False if the two vectors point in the same direction.
+	double rms_error; // Root mean square angle in radians between the other starmap vectors and their computed directions.
+	double max_error; // Largest of those angles.
+};
+
+// Everything the threads need for ScoreReferencePairs(). Each pair only writes its own score.
+struct ReferencePairJob
+{
+	const IVec3* triangle_table;
+	const Starmap* starmap;
+	ReferencePair* out_pairs;
+};
+
+// Angle in radians between a symbol's starmap vector and the direction we computed for it.
+static double GetStarmapResidual(const IVec3 triangle_table[60], const Starmap& starmap, Quat rotation, Quat rotation_inv, s32 id)
+{
+	Vec3 computed = Rotate(GetSymbolDirection(id, triangle_table), rotation, rotation_inv);
+	return Angle(computed, Normalize(starmap.vectors[id - 1]));
+}
+
+static void ScoreReferencePairsChunk(void* data, s32 begin, s32 end)
+{
+	ReferencePairJob* job = (ReferencePairJob*)data;
+	const Starmap& starmap = *job->starmap;
+	for (s32 i = begin; i < end; ++i)
+	{
+		// Pair i is every first vector, followed by every other vector as the second one, in file order.
+		ReferencePair& pair = job->out_pairs[i];
+		s32 first = i / (starmap.count - 1);
+		s32 second = i % (starmap.count - 1);
+		if (second >= first) ++second;
+		pair.first = starmap.ids[first];
+		pair.second = starmap.ids[second];
+		pair.order = i;
+		pair.rms_error = 0.0;
+		pair.max_error = 0.0;
+
+		Vec3 a = starmap.vectors[pair.first - 1];
+		Vec3 b = starmap.vectors[pair.second - 1];
+		Vec3 symbol_a = GetSymbolDirection(pair.first, job->triangle_table);
+		Vec3 symbol_b = GetSymbolDirection(pair.second, job->triangle_table);
+		pair.valid = LengthSquared(Cross(symbol_a, symbol_b)) > EPSILON && LengthSquared(Cross(Normalize(a), Normalize(b))) > EPSILON;
+		if (!pair.valid) continue;
+
+		Quat rotation = GetBallRotation(job->triangle_table, pair.first, pair.second, a, b);
+		Quat rotation_inv = Invert(rotation);
+		double sum_squared = 0.0;
+		for (s32 j = 0; j < starmap.count; ++j)
+		{
+			s32 id = starmap.ids[j];
+			if (id == pair.first || id == pair.second) continue;
+			double error = GetStarmapResidual(job->triangle_table, starmap, rotation, rotation_inv, id);
+			sum_squared += error * error;
+			pair.max_error = Max(pair.max_error, error);
+		}
+		pair.rms_error = Sqrt(sum_squared / (starmap.count - 2));
+	}
+}
+
+/*
+Scores every ordered pair of starmap vectors as the reference pair, on every thread in the pool if one is given.
+out_pairs needs room for count * (count - 1) pairs, where count is the number of starmap vectors.
+They're written in order of the first vector, then the second.
+*/
+void ScoreReferencePairs(const IVec3 triangle_table[60], const Starmap& starmap, ReferencePair* out_pairs, ThreadPool* pool)
+{
+	ReferencePairJob job;
+	job.triangle_table = triangle_table;
+	job.starmap = &starmap;
+	job.out_pairs = out_pairs;
+
+	s32 pair_count = starmap.count * (starmap.count - 1);
+	if (pool) RunParallel(pool, pair_count, REFERENCE_PAIR_CHUNK_SIZE, ScoreReferencePairsChunk, &job);
+	else ScoreReferencePairsChunk(&job, 0, pair_count);
+}
+
+// Sorts valid pairs before invalid ones, then by the smallest RMS error. Ties keep the file order, so the output is always the same.
+static int CompareReferencePairs(const void* a, const void* b)
+{
+	const ReferencePair* pa = (const ReferencePair*)a;
+	const ReferencePair* pb = (const ReferencePair*)b;
+	if (pa->valid != pb->valid) return pa->valid ? -1 : 1;
+	if (pa->valid && pa->rms_error != pb->rms_error) return (pa->rms_error < pb->rms_error) ? -1 : 1;
+	return pa->order - pb->order;
+}
+
+/*
+Tries every pair of vectors in the starmap file as the reference pair, and prints the best few, along with the error for
+every starmap vector when using the best one. The symbol IDs of the best pair are what to pass to the other modes.
+We also print the error from fitting every vector at once, see FitStarmapRotation().
+The pairs are scored on thread_count threads, or one per core if thread_count is 0.
+
+Returns 0 if successful, or 1 if an error occured when reading/parsing the files, or there weren't enough starmap vectors.
+*/
+s32 RunReferencePairSearch(const char* mapping_3d_path, const char* starmap_path, s32 thread_count)
+{
+	IVec3 triangle_table[60];
+	if (!LoadTriangleTable(mapping_3d_path, triangle_table)) return 1;
+	NormalizeBallVertices();
+
+	Starmap starmap;
+	if (!LoadStarmap(starmap_path, &starmap)) return 1;
+	s32 count = starmap.count;
+	if (count < 3)
+	{
+		printf("Need at least 3 starmap vectors to compare reference pairs, but %s only has %d.\n", starmap_path, count);
+		return 1;
+	}
+
+	s32 pair_count = count * (count - 1);
+	ReferencePair* pairs = (ReferencePair*)malloc(pair_count * sizeof(ReferencePair));
+	ThreadPool pool;
+	StartThreadPool(&pool, thread_count);
+	ScoreReferencePairs(triangle_table, starmap, pairs, &pool);
+	StopThreadPool(&pool);
+	qsort(pairs, pair_count, sizeof(ReferencePair), CompareReferencePairs);
+
+	if (!pairs[0].valid)
+	{
+		printf("None of the starmap vectors in %s can be used as a reference pair.\n", starmap_path);
+		free(pairs);
+		return 1;
+	}
+
+	printf("Scored %d reference pairs from %d starmap vectors, errors are in radians.\n\n", pair_count, count);
+	printf("Rank,Symbol ID 1,Symbol ID 2,RMS Error,Max Error\n");
+	for (s32 i = 0; i < pair_count && i < REFERENCE_PAIR_REPORT_COUNT && pairs[i].valid; ++i)
+	{
+		const ReferencePair& pair = pairs[i];
+		printf("%d,%d,%d,%.15g,%.15g\n", i + 1, pair.first, pair.second, pair.rms_error, pair.max_error);
+	}
+
+	// Compare against fitting every vector at once, which is what LoadBall() does when both IDs are 0.
+	Quat fit_rotation;
+	if (FitStarmapRotation(starmap, triangle_table, &fit_rotation, nullptr))
+	{
+		Quat fit_rotation_inv = Invert(fit_rotation);
+		double sum_squared = 0.0;
+		double max_error = 0.0;
+		for (s32 i = 0; i < count; ++i)
+		{
+			double error = GetStarmapResidual(triangle_table, starmap, fit_rotation, fit_rotation_inv, starmap.ids[i]);
+			sum_squared += error * error;
+			max_error = Max(max_error, error);
+		}
+		printf("\nFitting every vector at once (use symbol IDs 0 and 0) gives an RMS error of %.15g, and a max error of %.15g.\n", Sqrt(sum_squared / count), max_error);
+	}
+
+	const ReferencePair& best = pairs[0];
+	printf("\nErrors using symbol IDs %d and %d:\n\n", best.first, best.second);
+	printf("Symbol ID,Error,Computed X,Computed Y,Computed Z,Starmap X,Starmap Y,Starmap Z\n");
+	Quat rotation = GetBallRotation(triangle_table, best.first, best.second, starmap.vectors[best.first - 1], starmap.vectors[best.second - 1]);
+	Quat rotation_inv = Invert(rotation);
+	for (s32 i = 0; i < count; ++i)
+	{
+		s32 id = starmap.ids[i];
+		Vec3 computed = Rotate(GetSymbolDirection(id, triangle_table), rotation, rotation_inv);
+		Vec3 v = starmap.vectors[id - 1];
+		double error = GetStarmapResidual(triangle_table, starmap, rotation, rotation_inv, id);
+		printf("%d,%.15g,%.15f,%.15f,%.15f,%.15f,%.15f,%.15f\n", id, error, computed.x, computed.y, computed.z, v.x, v.y, v.z);
+	}
+
+	free(pairs);
+	return 0;
+}
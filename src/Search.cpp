@@ -0,0 +1,234 @@
+#include "Core.h"
+
+/*
+SolveAddress() gives us the triangle that contains the desired vector, but that isn't always the address that gets us
+closest to it. The stargate takes us to the middle of the triangle, and near an edge (or a face boundary, where the
+triangles change shape) the middle of a neighbouring triangle can be closer than the middle of our own.
+
+So instead we do a beam search down the subdivisions. We start with the faces near the desired vector, and at each level
+we split every triangle in the beam into its 64 smaller ones, but only keep the ones near the desired vector. Those are
+ranked by how close their middle is to the desired vector, and the best few make up the beam for the next level.
+At the last level that's exactly the decoded direction from DecodeAddress(), so the final ranking is exact.
+
+Everything uses the same integer coordinates as DecodeAddress(), so the addresses always decode to what we scored.
+*/
+
+// Widest beam SearchAddress() will use. A width of 4 is already enough to fix almost every edge case.
+#define MAX_BEAM_WIDTH 64
+
+// How far from the desired vector a subdivided triangle's middle can be, in units of that triangle's side length,
+// for it to be considered at all. 1 covers the triangle containing the vector and the ones next to it, and going any
+// wider never found a better address in testing, it just made the search slower.
+#define SEARCH_NEIGHBOUR_RADIUS 1.0
+
+struct SearchCell
+{
+	s64 corners[3][2]; // Same as DecodeAddress().
+	s32 face; // Face index (symbol ID - 1).
+	s32 tris[SUBDIVISION_COUNT]; // Subdivided triangle index at each level so far.
+	double score; // Squared distance between the middle of the triangle and the desired vector, smaller is better.
+};
+
+// Direction to the middle of a triangle, not normalized.
+static Vec3 GetCellCentroid(const Face& face, const s64 corners[3][2])
+{
+	double u = (double)(corners[0][0] + corners[1][0] + corners[2][0]) / 3.0;
+	double v = (double)(corners[0][1] + corners[1][1] + corners[2][1]) / 3.0;
+	return BarycentricToCartesian(Vec2(u, v) * (1.0 / decode_scale), face.v0, face.v1, face.v2);
+}
+
+// We rank by the squared chord length instead of the angle. It's in the same order, doesn't need any trig,
+// and unlike a dot product it keeps its precision for the tiny angles at the bottom levels.
+static double ScoreCell(const Face& face, const s64 corners[3][2], Vec3 desired)
+{
+	Vec3 p = GetCellCentroid(face, corners);
+	return LengthSquared(p * (1.0 / Length(p)) - desired);
+}
+
+// Adds a cell to a beam sorted from best to worst, dropping the worst one if the beam is full.
+static void InsertIntoBeam(SearchCell* beam, s32* count, s32 width, const SearchCell& cell)
+{
+	if (*count == width && cell.score >= beam[width - 1].score) return;
+	s32 i = (*count < width) ? (*count)++ : width - 1;
+	for (; i > 0 && beam[i - 1].score > cell.score; --i) beam[i] = beam[i - 1];
+	beam[i] = cell;
+}
+
+// Distance from a point on a triangle's grid to the middle of one of its subdivided triangles, in units of their side length.
+static double GetGridDistance(s32 tri, double grid_u, double grid_v)
+{
+	const s8 (*grid)[2] = subdivision_tables<SUBDIVISION_AMOUNT>.corners[tri];
+	double du = grid_u - (grid[0][0] + grid[1][0] + grid[2][0]) * (1.0 / 3.0);
+	double dv = grid_v - (grid[0][1] + grid[1][1] + grid[2][1]) * (1.0 / 3.0);
+	return Max(Max(Abs(du), Abs(dv)), Abs(du + dv));
+}
+
+// Scores one of the subdivided triangles inside a cell in the beam, and adds it to the next beam if it's good enough.
+static void AddChildToBeam(const Face& face, const SearchCell& parent, s32 level, s32 tri, Vec3 desired, SearchCell* beam, s32* count, s32 width)
+{
+	SearchCell cell;
+	cell.face = parent.face;
+	memcpy(cell.tris, parent.tris, sizeof(cell.tris));
+	cell.tris[level] = tri;
+	GetChildCorners(parent.corners, tri, cell.corners);
+	cell.score = ScoreCell(face, cell.corners, desired);
+	InsertIntoBeam(beam, count, width, cell);
+}
+
+/*
+Projects the desired vector onto a face, in the integer coordinates used by DecodeAddress() (but not rounded).
+Returns false if the face points away from the vector, or is broken (see BuildFace()).
+*/
+static bool GetLatticePoint(const Face& face, Vec3 desired, double* out_u, double* out_v)
+{
+	double w0 = Dot(face.inv_basis[0], desired);
+	double w1 = Dot(face.inv_basis[1], desired);
+	double w2 = Dot(face.inv_basis[2], desired);
+	double sum = w0 + w1 + w2;
+	if (sum < EPSILON) return false;
+	*out_u = w1 / sum * decode_scale;
+	*out_v = w2 / sum * decode_scale;
+	return true;
+}
+
+/*
+Finds the address whose decoded direction is closest to the desired vector, keeping the best beam_width triangles
+at each level. The beam width is clamped to [1, MAX_BEAM_WIDTH]. The error is the angle in radians between
+the decoded direction and the desired vector.
+
+The result is never worse than SolveAddress(), and also finds addresses for vectors that don't hit any face.
+Returns true if successful. If no address could be found, the address is filled with zeroes and we return false.
+*/
+bool SearchAddress(const Ball& ball, Vec3 desired, s32 beam_width, s32 out_address[ADDRESS_LENGTH], double* out_error)
+{
+	if (beam_width < 1) beam_width = 1;
+	if (beam_width > MAX_BEAM_WIDTH) beam_width = MAX_BEAM_WIDTH;
+	if (!IsValidDirection(desired))
+	{
+		for (s32 i = 0; i < ADDRESS_LENGTH; ++i) out_address[i] = 0;
+		if (out_error) *out_error = 0.0;
+		return false;
+	}
+	Vec3 d = Normalize(desired);
+
+	SearchCell beams[2][MAX_BEAM_WIDTH];
+	SearchCell* beam = beams[0];
+	SearchCell* next_beam = beams[1];
+	s32 beam_count = 0;
+
+	// The first level is the candidate faces from the cube map, same as FindFirstSymbol(). If the vector is in a gap
+	// between faces, its cell might not have any candidates at all, so then we check every face instead.
+	s64 start = StartMetricsTimer();
+	const FaceIndexCell& index_cell = ball.face_index[GetFaceIndexCell(d)];
+	bool check_all = (index_cell.count == FACE_INDEX_OVERFLOW || index_cell.count == 0);
+	s32 candidate_count = check_all ? (s32)ARRAYCOUNT(ball.faces) : index_cell.count;
+	for (s32 c = 0; c < candidate_count; ++c)
+	{
+		SearchCell cell = {};
+		cell.face = check_all ? c : index_cell.faces[c];
+		const Face& face = ball.faces[cell.face];
+		double u, v;
+		if (!GetLatticePoint(face, d, &u, &v)) continue;
+		cell.corners[1][0] = decode_scale;
+		cell.corners[2][1] = decode_scale;
+		cell.score = ScoreCell(face, cell.corners, d);
+		InsertIntoBeam(beam, &beam_count, beam_width, cell);
+	}
+
+	RecordLatency(METRIC_FIRST_FACE, start);
+
+	for (s32 level = 0; level < SUBDIVISION_COUNT && beam_count > 0; ++level)
+	{
+		s64 level_start = StartMetricsTimer();
+		s32 next_count = 0;
+		for (s32 b = 0; b < beam_count; ++b)
+		{
+			const SearchCell& parent = beam[b];
+			const Face& face = ball.faces[parent.face];
+			double u, v;
+			GetLatticePoint(face, d, &u, &v);
+
+			// Where the desired vector is on this triangle's grid. The edges always line up with the u and v axes,
+			// they're just flipped for upside down triangles.
+			s64 step_u = (parent.corners[1][0] - parent.corners[0][0]) / SUBDIVISION_AMOUNT;
+			s64 step_v = (parent.corners[2][1] - parent.corners[0][1]) / SUBDIVISION_AMOUNT;
+			double grid_u = (u - (double)parent.corners[0][0]) / (double)step_u;
+			double grid_v = (v - (double)parent.corners[0][1]) / (double)step_v;
+
+			// Only look at the rows and columns near the vector. Distance on a triangular grid is the largest of the
+			// three barycentric differences, so nothing outside this box can be close enough. The clamping happens
+			// before rounding, since the vector can be a long way off the edge of a neighbouring face.
+			const double last = SUBDIVISION_AMOUNT - 1;
+			s32 min_v = (s32)Clamp(grid_v - SEARCH_NEIGHBOUR_RADIUS, 0.0, last);
+			s32 max_v = (s32)Clamp(grid_v + SEARCH_NEIGHBOUR_RADIUS, -1.0, last);
+			bool any_close = false;
+			for (s32 grid_row = min_v; grid_row <= max_v; ++grid_row)
+			{
+				s32 min_u = (s32)Clamp(grid_u - SEARCH_NEIGHBOUR_RADIUS - 1.0, 0.0, last);
+				s32 max_u = (s32)Clamp(grid_u + SEARCH_NEIGHBOUR_RADIUS, -1.0, last - grid_row);
+				if (min_u > max_u) continue;
+				s32 first_tri = GetSubdividedTriangleIndex<SUBDIVISION_AMOUNT>(min_u, grid_row);
+				s32 last_tri = GetSubdividedTriangleIndex<SUBDIVISION_AMOUNT>(max_u, grid_row);
+				for (s32 tri = first_tri; tri <= last_tri; ++tri)
+				{
+					if (GetGridDistance(tri, grid_u, grid_v) > SEARCH_NEIGHBOUR_RADIUS) continue;
+					any_close = true;
+					AddChildToBeam(face, parent, level, tri, d, next_beam, &next_count, beam_width);
+				}
+			}
+
+			// If nothing is close enough, the vector is way off the edge of this face, and we drop it. Unless it's the best
+			// cell we have, which happens when the vector falls in a gap between faces. Then we keep its closest triangle.
+			if (!any_close && b == 0)
+			{
+				s32 closest = 0;
+				double closest_distance = GetGridDistance(0, grid_u, grid_v);
+				for (s32 tri = 1; tri < SUBDIVIDED_TRIANGLE_COUNT; ++tri)
+				{
+					double distance = GetGridDistance(tri, grid_u, grid_v);
+					if (distance < closest_distance)
+					{
+						closest_distance = distance;
+						closest = tri;
+					}
+				}
+				AddChildToBeam(face, parent, level, closest, d, next_beam, &next_count, beam_width);
+			}
+		}
+
+		SearchCell* swap = beam;
+		beam = next_beam;
+		next_beam = swap;
+		beam_count = next_count;
+		RecordLevelLatency(level, level_start);
+	}
+
+	// The greedy address usually ends up in the beam anyway, but a narrow beam can drop it early on, so check it too.
+	s32 greedy_address[ADDRESS_LENGTH];
+	DecodedAddress greedy = {};
+	bool greedy_solved = SolveAddress(ball, d, greedy_address) && DecodeAddress(ball, greedy_address, &d, &greedy);
+
+	if (beam_count > 0)
+	{
+		const SearchCell& best = beam[0];
+		double error = Angle(Normalize(GetCellCentroid(ball.faces[best.face], best.corners)), d);
+		if (!greedy_solved || error <= greedy.error)
+		{
+			out_address[0] = best.face + 1;
+			for (s32 i = 0; i < SUBDIVISION_COUNT; ++i) out_address[i + 1] = ball.mapping_table[best.tris[i]];
+			if (out_error) *out_error = error;
+			return true;
+		}
+	}
+
+	if (greedy_solved)
+	{
+		memcpy(out_address, greedy_address, sizeof(greedy_address));
+		if (out_error) *out_error = greedy.error;
+		return true;
+	}
+
+	for (s32 i = 0; i < ADDRESS_LENGTH; ++i) out_address[i] = 0;
+	if (out_error) *out_error = 0.0;
+	return false;
+}
@@ -0,0 +1,459 @@
+#include "Core.h"
+
+#include <chrono>
+#include <errno.h>
+#include <thread>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <afunix.h>
+#include <io.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+/*
+Serve mode, for when something else needs a lot of lookups, one or a few at a time. Starting the program for every lookup
+means loading and orienting the ball every time, so instead we do that once, and then answer requests until the input ends.
+
+Requests come in over stdin, or a Unix domain socket (which Windows 10 has too). Each request is one line, and gets one line
+back, in the same order:
+
+solve X,Y,Z                      -> ok S1,S2,S3,S4,S5,S6,S7,S8 (same address as batch mode)
+decode S1,S2,S3,S4,S5,S6,S7,S8   -> ok X,Y,Z (direction to the middle of the address's triangle)
+burb Grid Size,Desired X,Desired Y,Top Left X,...,Bottom Left Z  -> ok X,Y,Z (same row format as interburbulate)
+metrics                          -> ok file_path (writes the metrics so far, if the server was started with --metrics)
+
+Anything that can't be answered gets "err" and a message instead. Requests can be pipelined: we read as much as is available,
+answer every complete line in it as one batch, and write all the responses back in one go. With stdin, big batches are
+answered on every thread in the pool. Each socket client gets its own thread instead, so several can be served at once.
+*/
+
+// Size of each read from the input. Pipelined requests that arrive together get answered together.
+#define SERVE_READ_SIZE (64 * 1024)
+
+// Number of requests each thread answers at a time, and the smallest batch worth splitting up between threads.
+#define SERVE_CHUNK_SIZE 64
+
+// Longest response we can send back, including the newline. Error messages get cut off to fit.
+#define SERVE_RESPONSE_SIZE 320
+
+// How long to wait before accepting again when accepting a socket client fails. Doubles each time, up to 64 times this.
+#define SERVE_ACCEPT_RETRY_MS 10
+
+// Number of times in a row accepting can fail before we give up on the socket. That's about a minute of retrying.
+#define SERVE_MAX_ACCEPT_FAILURES 100
+
+#ifdef _WIN32
+typedef SOCKET ServeSocket;
+#define INVALID_SERVE_SOCKET INVALID_SOCKET
+#else
+typedef int ServeSocket;
+#define INVALID_SERVE_SOCKET -1
+#endif
+
+// Where requests come from and responses go. Either stdin and stdout, or both ends of a socket.
+struct ServeStream
+{
+	bool is_socket;
+	ServeSocket socket;
+};
+
+/*
+Reads whatever is available, up to size bytes. Returns the number of bytes read, 0 at the end of the input, or -1 if
+reading failed. Being interrupted by a signal isn't a failure, we just try again. Anything else gets printed to stderr,
+since stdout might be where the responses go.
+*/
+static s64 ReadServeStream(ServeStream* stream, char* buffer, s64 size)
+{
+	while (true)
+	{
+		s64 count;
+#ifdef _WIN32
+		if (stream->is_socket) count = recv(stream->socket, buffer, (int)size, 0);
+		else count = _read(0, buffer, (unsigned int)size);
+		s32 error = stream->is_socket ? WSAGetLastError() : errno;
+		bool interrupted = (error == (stream->is_socket ? WSAEINTR : EINTR));
+#else
+		if (stream->is_socket) count = recv(stream->socket, buffer, (size_t)size, 0);
+		else count = read(0, buffer, (size_t)size);
+		s32 error = errno;
+		bool interrupted = (error == EINTR);
+#endif
+		if (count >= 0) return count;
+		if (interrupted) continue;
+		fprintf(stderr, "Unable to read requests from %s, error %d\n", stream->is_socket ? "socket client" : "stdin", error);
+		return -1;
+	}
+}
+
+// Writes everything, however many calls it takes. Returns false if the other end has gone away.
+static bool WriteServeStream(ServeStream* stream, const char* data, s64 size)
+{
+	while (size > 0)
+	{
+		s64 count;
+#ifdef _WIN32
+		if (stream->is_socket) count = send(stream->socket, data, (int)size, 0);
+		else count = _write(1, data, (unsigned int)size);
+#elif defined(MSG_NOSIGNAL)
+		if (stream->is_socket) count = send(stream->socket, data, (size_t)size, MSG_NOSIGNAL);
+		else count = write(1, data, (size_t)size);
+#else
+		if (stream->is_socket) count = send(stream->socket, data, (size_t)size, 0);
+		else count = write(1, data, (size_t)size);
+#endif
+		if (count <= 0) return false;
+		data += count;
+		size -= count;
+	}
+	return true;
+}
+
+static void CloseServeSocket(ServeSocket socket)
+{
+#ifdef _WIN32
+	closesocket(socket);
+#else
+	close(socket);
+#endif
+}
+
+struct ServeResponse
+{
+	s32 length;
+	char text[SERVE_RESPONSE_SIZE];
+};
+
+// Formats a response, making sure it always ends in a newline, even if it had to be cut off.
+static void SetServeResponse(ServeResponse* response, const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	s32 length = vsnprintf(response->text, sizeof(response->text) - 1, format, args);
+	va_end(args);
+	if (length < 0) length = 0;
+	if (length > (s32)sizeof(response->text) - 2) length = (s32)sizeof(response->text) - 2;
+	response->text[length++] = '\n';
+	response->length = length;
+}
+
+// Reads some fields of a request, the same way as a CSV row, see CsvReadField().
+template <typename T>
+static bool ReadServeFields(CsvReader* reader, T* fields, s32 field_count)
+{
+	for (s32 i = 0; i < field_count; ++i)
+	{
+		if (!CsvReadField(reader, &fields[i])) return false;
+	}
+	return true;
+}
+
+// Checks that there's nothing left at the end of a request.
+static bool ReadServeEnd(CsvReader* reader)
+{
+	return CsvAtRowEnd(reader) || CsvError(reader, reader->cursor, "too many fields");
+}
+
+/*
+Answers one request line. The line doesn't include its newline. line_number is only used for error messages,
+and counts the requests on this stream, starting from 1.
+*/
+static void AnswerServeRequest(const Ball& ball, const char* line, s64 length, s64 line_number, ServeResponse* response)
+{
+	// The fields are parsed with the CSV reader, so errors say exactly which column was wrong.
+	CsvFile file = {};
+	file.path = "request";
+	file.data = line;
+	file.size = length;
+	CsvReader reader = {};
+	reader.file = &file;
+	reader.cursor = line;
+	reader.end = line + length;
+	reader.line_start = line;
+	reader.line = line_number;
+
+	// The command is everything up to the first space.
+	while (reader.cursor < reader.end && IsCsvSpace(*reader.cursor)) ++reader.cursor;
+	const char* command = reader.cursor;
+	while (reader.cursor < reader.end && !IsCsvSpace(*reader.cursor) && !IsCsvLineEnd(*reader.cursor)) ++reader.cursor;
+	s64 command_length = reader.cursor - command;
+
+	if (command_length == 5 && memcmp(command, "solve", 5) == 0)
+	{
+		double v[3];
+		if (!ReadServeFields(&reader, v, 3) || !ReadServeEnd(&reader))
+		{
+			SetServeResponse(response, "err %s", reader.error);
+			return;
+		}
+		Vec3 desired = Vec3(v[0], v[1], v[2]);
+		if (!IsValidDirection(desired))
+		{
+			SetServeResponse(response, "err The vector has to be finite, and can't be zero");
+			return;
+		}
+		s32 address[ADDRESS_LENGTH];
+		if (!SolveAddress(ball, Normalize(desired), address))
+		{
+			SetServeResponse(response, "err The vector doesn't intersect any symbol faces");
+			return;
+		}
+		char symbols[SERVE_RESPONSE_SIZE];
+		s32 length = 0;
+		for (s32 i = 0; i < ADDRESS_LENGTH && length < (s32)sizeof(symbols); ++i) length += snprintf(symbols + length, sizeof(symbols) - length, (i > 0) ? ",%d" : "%d", address[i]);
+		SetServeResponse(response, "ok %s", symbols);
+	}
+	else if (command_length == 6 && memcmp(command, "decode", 6) == 0)
+	{
+		s32 address[ADDRESS_LENGTH];
+		if (!ReadServeFields(&reader, address, ADDRESS_LENGTH) || !ReadServeEnd(&reader))
+		{
+			SetServeResponse(response, "err %s", reader.error);
+			return;
+		}
+		DecodedAddress decoded;
+		if (!DecodeAddress(ball, address, nullptr, &decoded))
+		{
+			SetServeResponse(response, "err The address has symbols which can't be in those positions");
+			return;
+		}
+		SetServeResponse(response, "ok %.15f,%.15f,%.15f", decoded.centroid.x, decoded.centroid.y, decoded.centroid.z);
+	}
+	else if (command_length == 4 && memcmp(command, "burb", 4) == 0)
+	{
+		s32 grid[3];
+		double corners[9];
+		if (!ReadServeFields(&reader, grid, 3) || !ReadServeFields(&reader, corners, 9) || !ReadServeEnd(&reader))
+		{
+			SetServeResponse(response, "err %s", reader.error);
+			return;
+		}
+		Burb burb = {grid[0], {grid[1], grid[2]}, Vec3(corners[0], corners[1], corners[2]), Vec3(corners[3], corners[4], corners[5]), Vec3(corners[6], corners[7], corners[8])};
+		Vec3 result = burb.Interburbulate();
+		SetServeResponse(response, "ok %.15f,%.15f,%.15f", result.x, result.y, result.z);
+	}
+	else if (command_length == 7 && memcmp(command, "metrics", 7) == 0)
+	{
+		if (!ReadServeEnd(&reader)) SetServeResponse(response, "err %s", reader.error);
+		else if (!metrics_path) SetServeResponse(response, "err Metrics are off, start the server with --metrics=file_path to turn them on");
+		else if (!WriteMetrics(metrics_path)) SetServeResponse(response, "err Unable to write metrics file %s", metrics_path);
+		else SetServeResponse(response, "ok %s", metrics_path);
+	}
+	else SetServeResponse(response, "err Unknown request \"%.*s\", expected solve, decode, burb or metrics", (command_length > 32) ? 32 : (int)command_length, command);
+}
+
+// One batch of pipelined requests. Each request only writes its own response.
+struct ServeBatch
+{
+	const Ball* ball;
+	const char** lines;
+	s64* lengths;
+	s64 first_line_number;
+	ServeResponse* responses;
+	s32 count;
+	s32 capacity;
+};
+
+static void AnswerServeRequestsChunk(void* data, s32 begin, s32 end)
+{
+	ServeBatch* batch = (ServeBatch*)data;
+	for (s32 i = begin; i < end; ++i) AnswerServeRequest(*batch->ball, batch->lines[i], batch->lengths[i], batch->first_line_number + i, &batch->responses[i]);
+}
+
+static void AddServeRequest(ServeBatch* batch, const char* line, s64 length)
+{
+	if (batch->count == batch->capacity)
+	{
+		batch->capacity = batch->capacity ? batch->capacity * 2 : 256;
+		batch->lines = (const char**)realloc(batch->lines, batch->capacity * sizeof(const char*));
+		batch->lengths = (s64*)realloc(batch->lengths, batch->capacity * sizeof(s64));
+		batch->responses = (ServeResponse*)realloc(batch->responses, batch->capacity * sizeof(ServeResponse));
+	}
+	batch->lines[batch->count] = line;
+	batch->lengths[batch->count] = length;
+	++batch->count;
+}
+
+/*
+Answers requests from a stream until the input ends, or the other end goes away. Big batches are answered on every
+thread in the pool if one is given, and the responses are always in the same order as the requests.
+Returns false if reading the requests failed, after printing why.
+*/
+static bool ServeStreamRequests(const Ball& ball, ServeStream* stream, ThreadPool* pool)
+{
+	s64 capacity = SERVE_READ_SIZE * 2;
+	char* buffer = (char*)malloc(capacity);
+	s64 used = 0;
+	char* output = nullptr;
+	s64 output_capacity = 0;
+
+	ServeBatch batch = {};
+	batch.ball = &ball;
+	batch.first_line_number = 1;
+
+	bool done = false;
+	bool read_failed = false;
+	while (!done)
+	{
+		// Keep room for a full read after whatever partial line is left over from last time.
+		if (capacity - used < SERVE_READ_SIZE)
+		{
+			capacity *= 2;
+			buffer = (char*)realloc(buffer, capacity);
+		}
+		s64 count = ReadServeStream(stream, buffer + used, SERVE_READ_SIZE);
+		if (count < 0)
+		{
+			// Whatever partial line is left gets dropped, since the rest of it is never coming.
+			read_failed = true;
+			break;
+		}
+		if (count == 0) done = true;
+		used += count;
+
+		// Every complete line is a request. At the end of the input, so is whatever's left.
+		batch.count = 0;
+		const char* p = buffer;
+		const char* end = buffer + used;
+		while (p < end)
+		{
+			const char* newline = (const char*)memchr(p, '\n', end - p);
+			if (!newline && !done) break;
+			const char* line_end = newline ? newline : end;
+			if (!IsCsvLineBlank(p, line_end)) AddServeRequest(&batch, p, line_end - p);
+			p = newline ? newline + 1 : end;
+		}
+
+		if (batch.count > 0)
+		{
+			if (pool && batch.count > SERVE_CHUNK_SIZE) RunParallel(pool, batch.count, SERVE_CHUNK_SIZE, AnswerServeRequestsChunk, &batch);
+			else AnswerServeRequestsChunk(&batch, 0, batch.count);
+
+			s64 output_size = 0;
+			for (s32 i = 0; i < batch.count; ++i) output_size += batch.responses[i].length;
+			if (output_size > output_capacity)
+			{
+				output_capacity = output_size * 2;
+				output = (char*)realloc(output, output_capacity);
+			}
+			s64 offset = 0;
+			for (s32 i = 0; i < batch.count; ++i)
+			{
+				memcpy(output + offset, batch.responses[i].text, batch.responses[i].length);
+				offset += batch.responses[i].length;
+			}
+			if (!WriteServeStream(stream, output, offset)) done = true;
+			batch.first_line_number += batch.count;
+		}
+
+		// Move the partial line to the front, to be finished off by the next read.
+		used = end - p;
+		memmove(buffer, p, used);
+	}
+
+	free(batch.lines);
+	free(batch.lengths);
+	free(batch.responses);
+	free(output);
+	free(buffer);
+	return !read_failed;
+}
+
+static void ServeSocketClient(const Ball* ball, ServeSocket client)
+{
+	ServeStream stream = {true, client};
+	ServeStreamRequests(*ball, &stream, nullptr);
+	CloseServeSocket(client);
+}
+
+/*
+Listens on a Unix domain socket, and answers requests from every client that connects, each on its own thread.
+Only returns if the socket can't be set up, or accepting clients keeps failing. Returns false after printing an error.
+*/
+static bool ServeSocketClients(const Ball& ball, const char* socket_path)
+{
+#ifdef _WIN32
+	WSADATA wsa_data;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0)
+	{
+		printf("Unable to start Winsock\n");
+		return false;
+	}
+#endif
+
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (strlen(socket_path) >= sizeof(address.sun_path))
+	{
+		printf("Socket path %s is too long\n", socket_path);
+		return false;
+	}
+	strcpy(address.sun_path, socket_path);
+
+	// A socket file left over from last time would stop us from binding.
+	remove(socket_path);
+	ServeSocket listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener == INVALID_SERVE_SOCKET || bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 16) != 0)
+	{
+		printf("Unable to listen on socket %s\n", socket_path);
+		if (listener != INVALID_SERVE_SOCKET) CloseServeSocket(listener);
+		return false;
+	}
+
+	printf("Serving requests on socket %s\n", socket_path);
+	fflush(stdout);
+	s32 failures = 0;
+	while (true)
+	{
+		ServeSocket client = accept(listener, nullptr, nullptr);
+		if (client != INVALID_SERVE_SOCKET)
+		{
+			failures = 0;
+			std::thread(ServeSocketClient, &ball, client).detach();
+			continue;
+		}
+
+		// Usually this is running out of file handles, which goes away once some clients disconnect, so wait a bit
+		// (longer each time) instead of spinning on it. If it never goes away, give up.
+		if (++failures >= SERVE_MAX_ACCEPT_FAILURES)
+		{
+			printf("Unable to accept clients on socket %s, giving up after %d tries\n", socket_path, failures);
+			CloseServeSocket(listener);
+			return false;
+		}
+		if (failures == 1) printf("Unable to accept a client on socket %s, retrying\n", socket_path);
+		fflush(stdout);
+		s32 delay = SERVE_ACCEPT_RETRY_MS << ((failures < 7) ? failures - 1 : 6);
+		std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+	}
+}
+
+/*
+Loads and orients the ball once, and then answers requests until the input ends, see the top of this file.
+If socket_path is null, requests come from stdin and responses go to stdout. Otherwise we listen on a Unix domain
+socket at that path, until accepting clients keeps failing. Stdin requests are answered on thread_count threads, or one per core if thread_count is 0.
+See LoadBall() for the other arguments, which can include a seed pack.
+
+Returns 0 when the input ends, or 1 if an error occured when reading/parsing the files, reading stdin, or setting up the socket.
+*/
+s32 RunServe(s32 id1, s32 id2, const char* socket_path, const char* mapping_3d_path, const char* starmap_path, const char* mapping_2d_path, s32 thread_count)
+{
+	// Socket clients are answered on detached threads, which can still be using the ball after ServeSocketClients() gives
+	// up and we return. So it lives until the program exits, rather than on our stack.
+	static Ball ball;
+	if (!LoadBall(id1, id2, mapping_3d_path, starmap_path, mapping_2d_path, &ball)) return 1;
+
+	if (socket_path) return ServeSocketClients(ball, socket_path) ? 0 : 1;
+
+	// Anything printed so far would end up mixed in with the responses.
+	fflush(stdout);
+	ThreadPool pool;
+	StartThreadPool(&pool, thread_count);
+	ServeStream stream = {false, INVALID_SERVE_SOCKET};
+	bool read = ServeStreamRequests(ball, &stream, &pool);
+	StopThreadPool(&pool);
+	return read ? 0 : 1;
+}
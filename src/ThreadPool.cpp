@@ -0,0 +1,198 @@
+#include "Core.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/*
+A small thread pool for splitting a big job into chunks and running them on every core.
+
+The job is a range of items, cut up into chunks of a fixed size. Every thread starts out with its own
+queue holding an even share of the chunks, and takes chunks off the front of it. Once a thread runs out,
+it steals the back half of someone else's queue, so the threads that got easy chunks end up helping the
+ones that didn't. Each queue is just a range of chunk indices with a lock, since popping a chunk is cheap
+compared to solving one.
+
+Which thread runs which chunk changes from run to run, so jobs should only ever write to their own items.
+Then the results are exactly the same no matter how many threads there are.
+*/
+
+// Processes items [begin, end) of a job. Called from several threads at once, with different ranges.
+typedef void ParallelJob(void* data, s32 begin, s32 end);
+
+struct WorkQueue
+{
+	std::mutex lock;
+	s32 head; // Next chunk the owning thread will take.
+	s32 tail; // One past the last chunk in the queue.
+};
+
+struct ThreadPool
+{
+	s32 thread_count; // Including the thread that calls RunParallel().
+	std::thread* threads;
+	WorkQueue* queues;
+
+	std::mutex lock;
+	std::condition_variable start_signal;
+	std::condition_variable done_signal;
+	u32 generation; // Goes up by one every time a job starts, so the workers know to wake up.
+	s32 busy_count;
+	bool quit;
+
+	// The current job.
+	ParallelJob* job;
+	void* data;
+	s32 item_count;
+	s32 chunk_size;
+};
+
+// Takes the next chunk from the front of a queue. Returns false if the queue is empty.
+static bool PopChunk(WorkQueue* queue, s32* out_chunk)
+{
+	std::lock_guard<std::mutex> guard(queue->lock);
+	if (queue->head >= queue->tail) return false;
+	*out_chunk = queue->head++;
+	return true;
+}
+
+/*
+Looks through the other queues for one that still has chunks, and moves the back half of it into our own (empty) queue.
+Returns false if every queue is empty, which means the job is finished, or will be once the chunks in progress are done.
+*/
+static bool StealChunks(ThreadPool* pool, s32 thief)
+{
+	for (s32 i = 1; i < pool->thread_count; ++i)
+	{
+		WorkQueue* victim = &pool->queues[(thief + i) % pool->thread_count];
+		s32 begin, end;
+		{
+			std::lock_guard<std::mutex> guard(victim->lock);
+			s32 remaining = victim->tail - victim->head;
+			if (remaining <= 0) continue;
+			end = victim->tail;
+			begin = end - (remaining + 1) / 2;
+			victim->tail = begin;
+		}
+
+		WorkQueue* queue = &pool->queues[thief];
+		std::lock_guard<std::mutex> guard(queue->lock);
+		queue->head = begin;
+		queue->tail = end;
+		return true;
+	}
+	return false;
+}
+
+// Runs chunks of the current job on one thread until there aren't any left to take or steal.
+static void RunChunks(ThreadPool* pool, s32 index)
+{
+	WorkQueue* queue = &pool->queues[index];
+	for (;;)
+	{
+		s32 chunk;
+		if (!PopChunk(queue, &chunk))
+		{
+			if (!StealChunks(pool, index)) return;
+			continue;
+		}
+		s32 begin = chunk * pool->chunk_size;
+		s32 end = begin + pool->chunk_size;
+		if (end > pool->item_count) end = pool->item_count;
+		pool->job(pool->data, begin, end);
+	}
+}
+
+static void WorkerThread(ThreadPool* pool, s32 index)
+{
+	u32 seen_generation = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> guard(pool->lock);
+			pool->start_signal.wait(guard, [&]{return pool->quit || pool->generation != seen_generation;});
+			if (pool->quit) return;
+			seen_generation = pool->generation;
+		}
+
+		RunChunks(pool, index);
+
+		std::lock_guard<std::mutex> guard(pool->lock);
+		if (--pool->busy_count == 0) pool->done_signal.notify_one();
+	}
+}
+
+/*
+Starts up a pool with the given number of threads, counting the calling thread.
+A thread count of 0 or less means one thread per core. A thread count of 1 doesn't start any threads,
+and jobs just run on the calling thread.
+*/
+void StartThreadPool(ThreadPool* pool, s32 thread_count)
+{
+	if (thread_count <= 0) thread_count = (s32)std::thread::hardware_concurrency();
+	if (thread_count <= 0) thread_count = 1;
+
+	pool->thread_count = thread_count;
+	pool->queues = new WorkQueue[thread_count];
+	pool->generation = 0;
+	pool->busy_count = 0;
+	pool->quit = false;
+	pool->threads = new std::thread[thread_count - 1];
+	for (s32 i = 1; i < thread_count; ++i) pool->threads[i - 1] = std::thread(WorkerThread, pool, i);
+}
+
+void StopThreadPool(ThreadPool* pool)
+{
+	{
+		std::lock_guard<std::mutex> guard(pool->lock);
+		pool->quit = true;
+	}
+	pool->start_signal.notify_all();
+	for (s32 i = 1; i < pool->thread_count; ++i) pool->threads[i - 1].join();
+	delete[] pool->threads;
+	delete[] pool->queues;
+	pool->threads = nullptr;
+	pool->queues = nullptr;
+}
+
+/*
+Runs a job over items [0, item_count) in chunks of chunk_size items, using every thread in the pool.
+The calling thread helps out, and this doesn't return until every chunk is done.
+*/
+void RunParallel(ThreadPool* pool, s32 item_count, s32 chunk_size, ParallelJob* job, void* data)
+{
+	if (item_count <= 0) return;
+	if (chunk_size <= 0) chunk_size = 1;
+	s32 chunk_count = (item_count + chunk_size - 1) / chunk_size;
+
+	// No point waking everyone up for one chunk.
+	if (pool->thread_count == 1 || chunk_count == 1)
+	{
+		job(data, 0, item_count);
+		return;
+	}
+
+	// Hand out an even share of the chunks to each thread.
+	for (s32 i = 0; i < pool->thread_count; ++i)
+	{
+		std::lock_guard<std::mutex> guard(pool->queues[i].lock);
+		pool->queues[i].head = (s32)((s64)chunk_count * i / pool->thread_count);
+		pool->queues[i].tail = (s32)((s64)chunk_count * (i + 1) / pool->thread_count);
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(pool->lock);
+		pool->job = job;
+		pool->data = data;
+		pool->item_count = item_count;
+		pool->chunk_size = chunk_size;
+		pool->busy_count = pool->thread_count - 1;
+		++pool->generation;
+	}
+	pool->start_signal.notify_all();
+
+	RunChunks(pool, 0);
+
+	std::unique_lock<std::mutex> guard(pool->lock);
+	pool->done_signal.wait(guard, [&]{return pool->busy_count == 0;});
+}
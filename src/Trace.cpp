@@ -0,0 +1,160 @@
+#include "Core.h"
+
+#include <atomic>
+#include <stdarg.h>
+
+/*
+Tracepoints, for when we need to see what the solver is actually doing with one particular seed or vector.
+
+The solvers used to print every step as they went, which is great for checking our work on a single vector, but it's
+way too slow (and noisy) for anything else, and the checks for it were sitting in the hottest loops we have.
+So now each step is a TRACE() with a category and a level, and in release builds they compile to nothing at all
+(the arguments don't even get evaluated). In debug builds, or with TRACE_ENABLED defined as 1, every trace gets
+written into a ring buffer instead, which only keeps the latest TRACE_RING_SIZE messages, and gets printed whenever
+someone asks for it: with --trace on the command line (see main()), or by the ball mode after each step.
+
+Tracing from several threads at once is fine, each message takes the next slot in the ring. Dumping the ring while
+other threads are still tracing isn't, so only do that once they're done.
+*/
+
+#ifndef TRACE_ENABLED
+#ifdef DEBUG
+#define TRACE_ENABLED 1
+#else
+#define TRACE_ENABLED 0
+#endif
+#endif
+
+// Which part of the solver a trace comes from. These are bits, so a mask can pick any of them.
+enum TraceCategory
+{
+	TRACE_PARSING = 1 << 0, // Reading CSV files and seed packs.
+	TRACE_ORIENTATION = 1 << 1, // Lining the ball up with the starmap.
+	TRACE_FIRST_SYMBOL = 1 << 2, // Finding the face the desired vector goes through.
+	TRACE_DESCENT = 1 << 3, // Each subdivision level after that.
+	TRACE_ALL = (1 << 4) - 1,
+};
+
+// How much detail a trace has. Filtering on a level keeps that level and everything above it.
+enum TraceLevel
+{
+	TRACE_STAGE = 1, // One line for the result of each step.
+	TRACE_DETAIL = 2, // All the geometry behind it.
+};
+
+// Longest message a trace keeps. Anything longer gets cut off, so traces should be one line each.
+#define TRACE_MESSAGE_SIZE 160
+
+// Number of messages the ring holds. Once it's full, each new message replaces the oldest one.
+#define TRACE_RING_SIZE 4096
+
+// Which traces get recorded. Everything, unless --trace says otherwise.
+static u32 trace_categories = TRACE_ALL;
+static TraceLevel trace_level = TRACE_DETAIL;
+
+#if TRACE_ENABLED
+struct TraceMessage
+{
+	TraceCategory category;
+	TraceLevel level;
+	char text[TRACE_MESSAGE_SIZE];
+};
+
+static TraceMessage trace_ring[TRACE_RING_SIZE];
+static std::atomic<u64> trace_next; // Number of messages ever traced, so the next one goes in slot trace_next % TRACE_RING_SIZE.
+static u64 trace_dumped; // Messages before this one have been dumped already.
+
+inline bool TraceWanted(TraceCategory category, TraceLevel level)
+{
+	return (trace_categories & category) && level <= trace_level;
+}
+
+// Use TRACE() instead of calling this, so that it compiles out of release builds.
+void Trace(TraceCategory category, TraceLevel level, const char* format, ...)
+{
+	TraceMessage& message = trace_ring[trace_next++ % TRACE_RING_SIZE];
+	message.category = category;
+	message.level = level;
+	va_list args;
+	va_start(args, format);
+	vsnprintf(message.text, sizeof(message.text), format, args);
+	va_end(args);
+}
+
+#define TRACE(category, level, ...) do { if (TraceWanted(category, level)) Trace(category, level, __VA_ARGS__); } while (0)
+#else
+inline bool TraceWanted(TraceCategory category, TraceLevel level) { return false; }
+
+#define TRACE(category, level, ...) ((void)0)
+#endif
+
+static const char* GetTraceCategoryName(TraceCategory category)
+{
+	switch (category)
+	{
+		case TRACE_PARSING: return "parsing";
+		case TRACE_ORIENTATION: return "orientation";
+		case TRACE_FIRST_SYMBOL: return "first-symbol";
+		case TRACE_DESCENT: return "descent";
+		default: return "?";
+	}
+}
+
+/*
+Prints every message traced since the last dump, oldest first, and how many got dropped if the ring filled up in between.
+Does nothing in release builds.
+*/
+void DumpTrace(FILE* file)
+{
+#if TRACE_ENABLED
+	u64 end = trace_next;
+	u64 begin = (end - trace_dumped > TRACE_RING_SIZE) ? end - TRACE_RING_SIZE : trace_dumped;
+	if (begin > trace_dumped) fprintf(file, "[trace] %llu older messages were dropped\n", (unsigned long long)(begin - trace_dumped));
+	for (u64 i = begin; i < end; ++i)
+	{
+		const TraceMessage& message = trace_ring[i % TRACE_RING_SIZE];
+		fprintf(file, "[%s] %s\n", GetTraceCategoryName(message.category), message.text);
+	}
+	trace_dumped = end;
+#endif
+}
+
+/*
+Parses which traces to record from the command line, as a comma separated list of categories, optionally followed by
+":stage" or ":detail" for the level. An empty list or "all" means every category. Returns false if it can't be parsed.
+For example, "first-symbol,descent:stage" only records the result of each step after the ball has been oriented.
+*/
+bool ParseTraceFilter(const char* filter)
+{
+	u32 categories = 0;
+	TraceLevel level = TRACE_DETAIL;
+	const char* p = filter;
+	while (*p && *p != ':')
+	{
+		const char* name_end = p;
+		while (*name_end && *name_end != ',' && *name_end != ':') ++name_end;
+		size_t length = name_end - p;
+
+		u32 category = 0;
+		if (length == 3 && strncmp(p, "all", 3) == 0) category = TRACE_ALL;
+		for (u32 bit = 1; bit < TRACE_ALL && !category; bit <<= 1)
+		{
+			const char* name = GetTraceCategoryName((TraceCategory)bit);
+			if (strlen(name) == length && strncmp(p, name, length) == 0) category = bit;
+		}
+		if (!category) return false;
+		categories |= category;
+
+		p = (*name_end == ',') ? name_end + 1 : name_end;
+	}
+
+	if (*p == ':')
+	{
+		if (strcmp(p + 1, "stage") == 0) level = TRACE_STAGE;
+		else if (strcmp(p + 1, "detail") != 0) return false;
+	}
+
+	trace_categories = categories ? categories : TRACE_ALL;
+	trace_level = level;
+	return true;
+}